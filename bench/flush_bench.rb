@@ -0,0 +1,36 @@
+# 测量关闭数据库时把大量脏页刷回文件的时间
+# 用法: ruby bench/flush_bench.rb [可执行文件] [页数]
+# 可以分别传入修改前后编译的可执行文件来比较
+require 'benchmark'
+require 'tempfile'
+
+binary = ARGV[0] || './cmake-build-debug/myDataBase'
+pages = (ARGV[1] || 100000).to_i
+db = 'bench.db'
+
+# 顺序插入时叶子分裂后各留一半，这样的短行每个叶子大约100行
+rows = pages * 100
+commands = (1..rows).map { |i| "insert #{i} u#{i} e#{i}" }
+
+# 缓冲池放得下所有页，并且不用wal，所有页都在.exit时才写回
+def run(binary, db, pages, input)
+  File.delete(db) if File.exist?(db)
+  Benchmark.realtime do
+    `#{binary} #{db} --no-wal --frames #{pages + 1000} < #{input.path}`
+  end
+end
+
+Tempfile.create('bench') do |without_exit|
+  Tempfile.create('bench') do |with_exit|
+    without_exit.write(commands.map { |command| command + "\n" }.join)
+    without_exit.flush
+    with_exit.write(commands.map { |command| command + "\n" }.join + ".exit\n")
+    with_exit.flush
+
+    # 读到EOF时进程直接退出，不会刷盘，两次运行的时间差就是刷盘的时间
+    insert_time = run(binary, db, pages, without_exit)
+    total_time = run(binary, db, pages, with_exit)
+    printf("%d行，%d页，插入 %.3fs，刷盘 %.3fs\n", rows, File.size(db) / 4096, insert_time, total_time - insert_time)
+  end
+end
+File.delete(db)
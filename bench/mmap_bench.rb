@@ -0,0 +1,38 @@
+# 比较read和mmap两种读页方式
+# 用法: ruby bench/mmap_bench.rb [可执行文件] [行数] [查询次数]
+require 'benchmark'
+require 'tempfile'
+
+binary = ARGV[0] || './cmake-build-debug/myDataBase'
+rows = (ARGV[1] || 50000).to_i
+lookups = (ARGV[2] || 200000).to_i
+db = 'bench.db'
+
+# 输入先写进文件，避免输入输出都很大时管道互相阻塞
+def run(binary, db, options, commands)
+  Tempfile.create('bench') do |input|
+    input.write(commands.map { |command| command + "\n" }.join)
+    input.flush
+    `#{binary} #{db} #{options} < #{input.path}`.force_encoding(Encoding::UTF_8)
+  end
+end
+
+File.delete(db) if File.exist?(db)
+insert = (1..rows).to_a.shuffle(random: Random.new(1)).map do |i|
+  "insert #{i} user#{i} person#{i}@example.com"
+end
+run(binary, db, '--no-wal', insert + ['.exit'])
+puts "#{rows}行，#{File.size(db) / 4096}页，每种方式随机查询#{lookups}次"
+
+# 缓冲池比表小得多，大部分查询都要重新读入叶子
+random = Random.new(2)
+queries = (1..lookups).map { "select where id = #{random.rand(1..rows)}" } + ['.stats', '.exit']
+[['read', ''], ['mmap', '--mmap']].each do |name, option|
+  output = nil
+  time = Benchmark.realtime do
+    output = run(binary, db, "--frames 64 #{option}", queries)
+  end
+  stats = output.lines.grep(/^(pages_read|pages_mapped|evictions): /).map(&:strip).join(', ')
+  printf("%-5s %8.3fs  %s\n", name, time, stats)
+end
+File.delete(db)
@@ -0,0 +1,237 @@
+// 多线程读吞吐量：同一张表上1、2、4...个线程同时做点查和范围扫描，看随线程数的扩展
+// 表里预先装入偶数id，--writer时另有一个线程不断插入奇数id，让叶子和内部节点在读的同时分裂；
+// 读的线程检查每个偶数id都能查到、范围扫描有序且不漏行；同时统计点查的延迟，看插入会不会让读变慢
+// 用法: read_bench [行数] [每个线程的查询数] [最多线程数] [--writer]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mydb.h"
+
+#define RANGE_SPAN 1000 // 范围扫描覆盖的id跨度
+#define SCAN_EVERY 16 // 每多少次查询做一次范围扫描
+
+typedef struct {
+    Table* table;
+    uint32_t rows;
+    uint32_t queries;
+    uint32_t seed;
+    uint64_t errors;
+    double* latencies; // 每次点查的耗时
+    uint32_t num_latencies;
+} Reader;
+
+typedef struct {
+    Table* table;
+    uint32_t rows;
+    atomic_bool stop;
+    uint64_t inserted;
+} Writer;
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_double(const void* a, const void* b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+PreparedStatement* prepare(Table* table, const char* sql) {
+    PrepareResult result;
+    PreparedStatement* statement = db_prepare(table, sql, &result);
+    if (statement == NULL) {
+        printf("不能解析 '%s'\n", sql);
+        exit(EXIT_FAILURE);
+    }
+    return statement;
+}
+
+/**
+ * 读线程：点查随机的偶数id，隔一段做一次范围扫描
+ */
+void* reader_main(void* argument) {
+    Reader* reader = argument;
+    PreparedStatement* lookup = prepare(reader->table, "select id, username where id = ?");
+    PreparedStatement* scan = prepare(reader->table, "select id where id between ? and ?");
+    for (uint32_t i = 0; i < reader->queries; i++) {
+        uint32_t id = 2 * (rand_r(&reader->seed) % reader->rows);
+        if (i % SCAN_EVERY == SCAN_EVERY - 1) {
+            db_bind_int(scan, 1, id);
+            db_bind_int(scan, 2, id + RANGE_SPAN);
+            uint32_t expected = id;
+            uint32_t last = 0;
+            bool first = true;
+            while (db_step(scan) == EXECUTE_ROW) {
+                uint32_t key = db_column_int(scan, 0);
+                if ((!first && key <= last) || (key % 2 == 0 && key != expected)) {
+                    reader->errors++;
+                }
+                if (key % 2 == 0) {
+                    expected = key + 2;
+                }
+                last = key;
+                first = false;
+            }
+            uint32_t end = id + RANGE_SPAN;
+            if (end > 2 * (reader->rows - 1)) {
+                end = 2 * (reader->rows - 1);
+            }
+            if (expected != end + 2) {
+                // 范围内的偶数id应该一个不少
+                reader->errors++;
+            }
+            continue;
+        }
+        double start = now();
+        db_bind_int(lookup, 1, id);
+        uint32_t length;
+        if (db_step(lookup) != EXECUTE_ROW || db_column_int(lookup, 0) != id ||
+            db_column_text(lookup, 1, &length) == NULL) {
+            reader->errors++;
+        }
+        db_reset(lookup);
+        reader->latencies[reader->num_latencies++] = now() - start;
+    }
+    db_finalize(lookup);
+    db_finalize(scan);
+    return NULL;
+}
+
+/**
+ * 写线程：随机插入奇数id，直到读的线程都结束
+ */
+void* writer_main(void* argument) {
+    Writer* writer = argument;
+    PreparedStatement* insert = prepare(writer->table, "insert ? ? ?");
+    uint32_t seed = 12345;
+    db_bind_text(insert, 2, "writer");
+    db_bind_text(insert, 3, "writer@example.com");
+    while (!writer->stop) {
+        db_bind_int(insert, 1, 2 * (rand_r(&seed) % writer->rows) + 1);
+        if (db_step(insert) == EXECUTE_SUCCESS) {
+            writer->inserted++;
+        }
+    }
+    db_finalize(insert);
+    return NULL;
+}
+
+/**
+ * 解析正整数参数，不是正整数时退出
+ */
+uint32_t parse_count(const char* text, const char* name) {
+    char* end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (*text == '-' || *end != '\0' || value == 0 || value > UINT32_MAX) {
+        printf("%s必须是正整数：'%s'\n", name, text);
+        exit(EXIT_FAILURE);
+    }
+    return (uint32_t)value;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t rows = argc > 1 ? parse_count(argv[1], "行数") : 200000;
+    uint32_t queries = argc > 2 ? parse_count(argv[2], "查询数") : 200000;
+    uint32_t max_threads = argc > 3 ? parse_count(argv[3], "线程数") : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    bool with_writer = argc > 4 && strcmp(argv[4], "--writer") == 0;
+    const char* filename = "read_bench.db";
+    unlink(filename);
+
+    DbOptions options = default_db_options();
+    options.num_frames = 16384;
+    options.use_wal = false;
+    OpenResult open_result;
+    Table* table = db_open(filename, &options, &open_result);
+    if (table == NULL) {
+        printf("打开数据库失败：%d\n", open_result);
+        return EXIT_FAILURE;
+    }
+
+    // 一个事务装入所有偶数id，commit时排序后批量插入
+    PreparedStatement* begin = prepare(table, "begin");
+    PreparedStatement* commit = prepare(table, "commit");
+    PreparedStatement* insert = prepare(table, "insert ? ? ?");
+    db_step(begin);
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+    for (uint32_t i = 0; i < rows; i++) {
+        snprintf(username, sizeof(username), "user%u", 2 * i);
+        snprintf(email, sizeof(email), "person%u@example.com", 2 * i);
+        db_bind_int(insert, 1, 2 * i);
+        db_bind_text(insert, 2, username);
+        db_bind_text(insert, 3, email);
+        db_step(insert);
+    }
+    if (db_step(commit) != EXECUTE_SUCCESS) {
+        printf("装入失败\n");
+        return EXIT_FAILURE;
+    }
+    db_finalize(begin);
+    db_finalize(commit);
+    db_finalize(insert);
+
+    printf("%u行，每个线程%u次查询(每%d次一次%d个id的范围扫描)%s\n",
+           rows, queries, SCAN_EVERY, RANGE_SPAN, with_writer ? "，同时有一个线程在插入" : "");
+    printf("%8s %12s %14s %8s %12s %12s %12s\n", "线程数", "耗时(秒)", "查询/秒", "加速比", "插入/秒",
+           "p50(微秒)", "p99(微秒)");
+    double single = 0;
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        Reader readers[threads];
+        pthread_t ids[threads];
+        Writer writer = {table, rows, false, 0};
+        pthread_t writer_id;
+        if (with_writer) {
+            pthread_create(&writer_id, NULL, writer_main, &writer);
+        }
+        double start = now();
+        for (uint32_t i = 0; i < threads; i++) {
+            readers[i] = (Reader){table, rows, queries, 1000 + i, 0, malloc(sizeof(double) * queries), 0};
+            pthread_create(&ids[i], NULL, reader_main, &readers[i]);
+        }
+        uint64_t errors = 0;
+        for (uint32_t i = 0; i < threads; i++) {
+            pthread_join(ids[i], NULL);
+            errors += readers[i].errors;
+        }
+        double elapsed = now() - start;
+        // 所有线程的点查延迟放在一起排序
+        uint32_t num_latencies = 0;
+        double* latencies = malloc(sizeof(double) * threads * queries);
+        for (uint32_t i = 0; i < threads; i++) {
+            memcpy(latencies + num_latencies, readers[i].latencies, sizeof(double) * readers[i].num_latencies);
+            num_latencies += readers[i].num_latencies;
+            free(readers[i].latencies);
+        }
+        qsort(latencies, num_latencies, sizeof(double), compare_double);
+        if (with_writer) {
+            writer.stop = true;
+            pthread_join(writer_id, NULL);
+        }
+        double throughput = (double)threads * queries / elapsed;
+        if (threads == 1) {
+            single = throughput;
+        }
+        printf("%8u %12.3f %14.0f %8.2f %12.0f %12.1f %12.1f\n", threads, elapsed, throughput, throughput / single,
+               writer.inserted / elapsed, latencies[num_latencies / 2] * 1e6, latencies[num_latencies * 99 / 100] * 1e6);
+        free(latencies);
+        if (errors > 0) {
+            printf("错误：%lu次查询结果不对\n", (unsigned long)errors);
+            return EXIT_FAILURE;
+        }
+    }
+    ExecuteResult close_result = db_close(table);
+    unlink(filename);
+    if (close_result != EXECUTE_SUCCESS) {
+        printf("关闭数据库失败：%d\n", close_result);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
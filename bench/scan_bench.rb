@@ -0,0 +1,31 @@
+# 全表扫描吞吐量，可以传多个可执行文件比较改动前后
+# 用法: ruby bench/scan_bench.rb [行数] [扫描次数] [可执行文件...]
+require 'benchmark'
+require 'tempfile'
+
+rows = (ARGV[0] || 100000).to_i
+scans = (ARGV[1] || 10).to_i
+binaries = ARGV[2..] || []
+binaries = ['./cmake-build-debug/myDataBase'] if binaries.empty?
+db = 'bench.db'
+
+# 输入先写进文件，输出丢弃，只计扫描和格式化的时间
+def run(binary, db, options, commands)
+  Tempfile.create('bench') do |input|
+    input.write(commands.map { |command| command + "\n" }.join)
+    input.flush
+    system("#{binary} #{db} #{options} < #{input.path} > /dev/null")
+  end
+end
+
+insert = (1..rows).map { |i| "insert #{i} user#{i} person#{i}@example.com" }
+puts "#{rows}行，每个可执行文件扫描#{scans}次"
+binaries.each do |binary|
+  File.delete(db) if File.exist?(db)
+  run(binary, db, '--no-wal', insert + ['.exit'])
+  time = Benchmark.realtime do
+    run(binary, db, '--no-wal', ['select'] * scans + ['.exit'])
+  end
+  printf("%-40s %8.3fs  %10.0f行/秒\n", binary, time, rows * scans / time)
+end
+File.delete(db) if File.exist?(db)
@@ -0,0 +1,6048 @@
+#define _GNU_SOURCE // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING // linux上用io_uring做异步预读，其他平台退回同步I/O
+#endif
+#include "mydb.h"
+
+/////////////////////////////////////////////// 宏
+// 计算列属性所占空间
+#define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
+
+// 表属性
+#define TABLE_MAX_PAGES UINT32_MAX // 页编号是uint32_t
+#ifndef MYDB_PAGE_SIZE
+#define MYDB_PAGE_SIZE 4096 // 页大小，编译时用-DMYDB_PAGE_SIZE修改，扫描多的场景可以用更大的页
+#endif
+#define MYDB_MIN_PAGE_SIZE 4096 // 直接I/O和mmap要求页按系统页对齐
+#define MYDB_MAX_PAGE_SIZE 65536
+#if MYDB_PAGE_SIZE < MYDB_MIN_PAGE_SIZE || MYDB_PAGE_SIZE > MYDB_MAX_PAGE_SIZE || (MYDB_PAGE_SIZE & (MYDB_PAGE_SIZE - 1)) != 0
+#error "MYDB_PAGE_SIZE必须是4096到65536之间的2的幂"
+#endif
+
+// 缓冲池
+#define PAGER_DEFAULT_FRAMES 1024 // 默认缓冲池帧数，每帧一页，4KB的页占用4MB
+#define PAGER_MIN_FRAMES 8 // 分裂时最多同时pin住几页，帧数不能比这个少
+#define PAGER_MAX_GROWTH 8 // 一条语句修改的页太多时缓冲池最多扩大到配置帧数的几倍
+#define PAGER_MAX_WRITE_RUN 256 // 一次pwritev最多合并的页数，不超过IOV_MAX
+#define PAGER_MMAP_RESERVE (1ULL << 36) // mmap模式预留的地址空间(64GB)，超出部分走read
+#define PAGER_DEFAULT_READ_AHEAD 8 // 扫描时预读后面的几个叶子
+#define PAGER_RING_ENTRIES 64 // io_uring队列长度
+
+// 预写日志
+#define WAL_DEFAULT_GROUP_SIZE 1 // 攒够多少个提交做一次fdatasync，默认每个提交都持久化之后才返回
+#define WAL_CHECKPOINT_SIZE (4 * 1024 * 1024) // wal超过4MB时做checkpoint
+
+// b树的最大深度(根到叶子经过的内部节点数)，内部节点扇出至少509，16层足够了
+#define BTREE_MAX_DEPTH 16
+
+// 批量导入
+#define IMPORT_RUN_SIZE (64 * 1024 * 1024) // .import在内存中排序的数据量，更大的文件分成多个有序run写到临时文件再归并
+#define IMPORT_BATCH_ROWS 4096 // 表里已经有数据时，.import每攒够这么多行作为一批插入并提交
+
+// 查询结果输出
+#define RESULT_SINK_BUFFER_SIZE (64 * 1024) // 结果先攒在缓冲区里，满了再一次写出去
+#define RESULT_SINK_MAX_ROW_SIZE (2 * (COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE) + 64) // 一行格式化之后最长的字节数(csv引号转义会翻倍)
+
+/////////////////////////////////////////////// 数据结构与枚举
+
+/**
+ * 页内偏移：64KB的页里内容区的起始位置可以等于65536，超出uint16_t
+ */
+#if MYDB_PAGE_SIZE > 32768
+typedef uint32_t PageOffset;
+#else
+typedef uint16_t PageOffset;
+#endif
+
+/**
+ * sql语句类型枚举
+ */
+typedef enum {
+    STATEMENT_INSERT,
+    STATEMENT_SELECT,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_ROLLBACK,
+    STATEMENT_DELETE
+} StatementType;
+
+/**
+ * 表的行
+ */
+typedef struct {
+    uint32_t id;
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+} Row;
+
+/**
+ * 列，按位组合表示要读取哪些列
+ */
+typedef enum {
+    COLUMN_ID = 1 << 0,
+    COLUMN_USERNAME = 1 << 1,
+    COLUMN_EMAIL = 1 << 2,
+    COLUMN_ALL = COLUMN_ID | COLUMN_USERNAME | COLUMN_EMAIL
+} Column;
+
+/**
+ * 行视图：字段直接指向页内的cell，不拷贝，字符串不以'\0'结尾
+ * 只在cell所在页被pin住的时候有效
+ */
+typedef struct {
+    uint32_t id;
+    const char* username;
+    uint8_t username_length;
+    const char* email;
+    uint8_t email_length;
+} RowView;
+
+/**
+ * 占位符'?'绑定到语句的哪个位置
+ */
+typedef enum {
+    PARAM_ID, // insert的id
+    PARAM_USERNAME, // insert的username
+    PARAM_EMAIL, // insert的email
+    PARAM_KEY, // where id = ?
+    PARAM_KEY_LOW, // where id between ? and ...
+    PARAM_KEY_HIGH // where id between ... and ?
+} ParamTarget;
+
+/**
+ * 语句中的一个占位符
+ */
+typedef struct {
+    ParamTarget target;
+    uint32_t row; // insert的第几行
+} ParamSlot;
+
+/**
+ * 语句类型
+ */
+typedef struct {
+    StatementType type;
+    Row row_to_insert;
+    Row* rows; // 多行insert的所有行，NULL时只有row_to_insert一行
+    uint32_t num_rows;
+    uint32_t key_low; // select和delete的id范围 [key_low, key_high]，不带where时是整个表
+    uint32_t key_high;
+    uint32_t columns; // select要读取的列
+    Column projection[3]; // select要输出的列，按输出顺序
+    uint32_t projection_count;
+    ParamSlot* params; // 占位符，按出现的顺序
+    uint32_t num_params;
+} Statement;
+
+/**
+ * 缓冲池中的一帧
+ */
+typedef struct {
+    void* data; // 页已经提交的内容，mmap模式下可能直接指向映射；提交之后不会再被修改，只会被整个替换
+    void* buffer; // 帧自己的内存，一开始从页管理器的arena中划分，提交时换成写线程的副本
+    void* working; // 写线程正在修改的副本，提交之前其他线程看不到，NULL表示没有
+    uint32_t page_num; // 帧中存放的页编号
+    uint32_t pin_count; // 正在使用这一帧的次数，大于0时不能被淘汰
+    bool in_use; // 帧中是否存放了页
+    bool dirty; // 页被修改过，淘汰前需要写回文件
+    bool referenced; // CLOCK算法的引用位
+    bool mapped; // data指向映射而不是buffer
+    bool io_pending; // 预读还没完成，完成前这一帧被I/O pin住
+    int32_t hash_next; // 页表同一个桶中的下一帧，-1表示没有；空闲帧用它串成空闲链表
+} Frame;
+
+/**
+ * 数据库文件头(meta页)的内容
+ */
+typedef struct {
+    uint32_t format_version; // 文件格式版本
+    uint32_t page_size; // 创建文件时的页大小
+    uint32_t flags; // META_FLAG_*
+    uint64_t txn_id; // 每写一次meta加一，两个meta页中大的那个是最新的
+    uint32_t root_page_num; // b树的根页
+    uint32_t num_pages; // 文件的页数，写时复制模式下超出的页是崩溃前没提交完的
+    uint32_t free_list_head; // 空闲页链表的第一页，0表示没有
+} Meta;
+
+/**
+ * 读取用的快照：只能看到版本号不超过version的提交
+ */
+typedef struct Snapshot {
+    uint64_t version;
+    uint32_t root_page_num; // 快照开始时已经提交的根页
+    struct Snapshot* prev; // 活跃快照链表，按版本从旧到新
+    struct Snapshot* next;
+} Snapshot;
+
+/**
+ * 页被新的提交取代的内容，还有快照可能读到它时保留下来
+ */
+typedef struct PageVersion {
+    void* data; // 页的旧内容，不会再被修改
+    uint64_t begin; // 从哪个版本开始可见
+    uint64_t end; // 从哪个版本开始被取代
+    uint32_t page_num;
+    struct PageVersion* older; // 同一页更旧的版本
+    struct PageVersion* next_retired; // 所有旧版本按end从小到大串起来，回收时从头开始
+} PageVersion;
+
+/**
+ * 一页的版本链
+ */
+typedef struct PageVersions {
+    uint32_t page_num;
+    uint64_t begin; // 当前内容从哪个版本开始可见
+    PageVersion* newest; // 旧版本，从新到旧
+    struct PageVersions* hash_next;
+} PageVersions;
+
+/**
+ * 刷盘时待写回的脏页，按页编号排序后相邻的页合并写
+ */
+typedef struct {
+    uint32_t page_num;
+    int32_t frame_num;
+    void* data; // 帧的内容，checkpoint不持锁写它，这时frames数组可能被其他线程扩大而移动
+} DirtyPage;
+
+/**
+ * wal记录类型
+ */
+typedef enum {
+    WAL_RECORD_INSERT = 1, // 插入一行：key + 变长的username和email
+    WAL_RECORD_PAGE = 2, // checkpoint时整页的镜像：页编号 + 页内容
+    WAL_RECORD_CHECKPOINT = 3, // checkpoint的页镜像已经全部写入
+    WAL_RECORD_DELETE = 4 // 删除一个范围的行：key_low + key_high
+} WalRecordType;
+
+/**
+ * 预写日志
+ */
+typedef struct {
+    int file_descriptor;
+    char* filename;
+    char* buffer; // 还没写进文件的记录
+    uint32_t buffer_length;
+    uint32_t buffer_capacity;
+    uint64_t file_length; // 已经写进文件的长度
+    uint32_t pending_commits; // 已经提交但还没有fdatasync的事务数
+    uint32_t group_size; // 攒够多少个提交做一次fdatasync
+    bool keep_records; // 正在重放或者正在应用一批插入、一次删除，checkpoint之后不能清空wal
+} Wal;
+
+/**
+ * 页管理器的I/O统计
+ */
+typedef struct {
+    uint64_t pages_read; // 从文件读入的页数
+    uint64_t pages_written; // 写回文件的页数
+    uint64_t pages_skipped; // 刷盘时因为没有修改而跳过的页数
+    uint64_t cache_hits; // 缓冲池命中次数
+    uint64_t evictions; // 淘汰的页数
+    uint64_t wal_syncs; // wal的fdatasync次数
+    uint64_t checkpoints; // checkpoint次数
+    uint64_t pages_mapped; // 直接使用映射、没有read的页数
+    uint64_t pages_prefetched; // 预读的页数
+    uint64_t versions_kept; // 为快照保留的旧版本页数
+} PagerStats;
+
+/**
+ * 页编号的动态数组
+ */
+typedef struct {
+    uint32_t* pages;
+    uint32_t count;
+    uint32_t capacity;
+} PageList;
+
+/**
+ * io_uring的提交队列和完成队列，只在linux上可用
+ */
+typedef struct Ring Ring;
+
+/**
+ * 页类型
+ */
+typedef struct {
+    int file_descriptor;
+    uint32_t num_pages;
+    uint64_t file_length; // 文件长度，大于4GB时超出uint32_t
+    uint32_t num_frames; // 缓冲池帧数
+    Frame* frames; // 缓冲池
+    char* arena; // 所有帧的内存，一次分配，按页对齐
+    uint32_t arena_frames; // arena中的帧数，也就是配置的帧数，缓冲池扩大之后新加的帧不在arena里，语句提交之后还回去
+    int32_t free_frames; // 空闲帧链表头，-1表示没有空闲帧
+    uint32_t clock_hand; // CLOCK算法的指针
+    uint32_t num_buckets; // 页表的桶数，是2的幂
+    int32_t* buckets; // 页表：页编号 -> 帧，-1表示空桶
+    uint32_t num_dirty; // 脏页数
+    Wal* wal; // 预写日志，NULL表示不使用
+    char* map; // mmap模式下预留的地址空间，NULL表示不使用mmap
+    uint64_t map_length; // 已经映射了文件的长度
+    Ring* ring; // 异步I/O，NULL表示不可用
+    uint32_t read_ahead; // 扫描时预读的叶子数，0表示不预读
+    PagerStats stats;
+    uint64_t committed_version; // 最近一次提交的版本号，新的快照从这里开始
+    Snapshot* oldest_snapshot; // 活跃快照链表，NULL表示没有正在进行的读
+    Snapshot* newest_snapshot;
+    PageVersions** versions; // 有旧版本的页：页编号 -> 版本链，桶数和页表相同
+    PageVersion* retired_head; // 所有旧版本，按end从小到大
+    PageVersion* retired_tail;
+    void* spare_buffers; // 回收的页内存，用每页开头的指针串成链表
+    int32_t* pending; // 有未提交副本的帧
+    uint32_t num_pending;
+    bool partial_commit; // 缓冲池到了上限，语句结束之前已经发布过一部分修改
+    uint32_t root_page_num; // 写线程看到的根页
+    uint32_t committed_root; // 最近一次提交的根页，新的快照从这里下降
+    bool copy_on_write; // 写时复制模式：已经持久化的页不原地修改，meta页发布新的根，不用wal
+    uint64_t txn_id; // 最近一次写进meta页的事务号
+    uint32_t free_list_head; // 空闲页链表的第一页，0表示没有
+    PageList free_pages; // 可以重用的空闲页，分配新页时先从这里取
+    PageList pending_free; // 写时复制模式下释放的、最近一次写的meta还引用着的页，下次写meta之后才能重用
+    PageList free_list_pages; // 现在保存空闲页链表的页
+    bool free_list_dirty; // 空闲页变过，持久化之前要重写空闲页链表
+    uint8_t* reused_pages; // 写时复制模式下从空闲页取出来的页的位图，它们编号小于fresh_page_num也可以原地修改
+    uint32_t reused_pages_size; // 位图的字节数
+    uint32_t fresh_page_num; // 编号不小于它的页是上次写meta之后分配的，还没有被meta引用，可以原地修改
+    char* meta_buffer; // 生成meta页用的一页按页对齐的内存(直接I/O要求)
+    uint32_t unsynced_commits; // 提交了但还没写meta的语句数
+    uint32_t group_size; // 攒够多少条语句写一次meta
+    bool flushing; // checkpoint正在不持锁写文件，脏页被它pin住
+    ExecuteResult error; // 第一次I/O失败或者发现损坏时记下，之后的语句都返回它，EXECUTE_SUCCESS表示没有错误
+    pthread_cond_t flushed; // checkpoint写完了，等帧的线程可以重试
+    pthread_mutex_t mutex; // 保护页表、帧的pin计数和脏标记、版本链、统计等元数据
+} Pager;
+
+/**
+ * 查询结果的输出：行先格式化到一块大缓冲区，满了或者语句结束时一次写到stdout
+ */
+typedef struct {
+    OutputMode mode;
+    char* buffer;
+    uint32_t length; // 缓冲区中已经格式化好的字节数
+} ResultSink;
+
+/**
+ * 表类型
+ */
+typedef struct Table {
+//    uint32_t num_rows; // 行总数
+//    void* pages[TABLE_MAX_PAGES]; // 所有的页
+    Pager* pager; // 所有的页，根页也由页管理器记录
+    ResultSink* sink; // 查询结果的输出
+    bool in_transaction; // begin之后、commit之前
+    Row* batch; // 事务中的插入先攒在这里，commit时排序后一起应用
+    uint32_t batch_length;
+    uint32_t batch_capacity;
+    pthread_mutex_t write_lock; // 同一时间只有一个线程修改b树，读不需要这个锁
+} Table;
+
+/**
+ * 从根下降到叶子时经过的内部节点
+ */
+typedef struct {
+    uint32_t page_num; // 内部节点所在页
+    uint32_t child_index; // 下降时选择的孩子序号(等于num_keys时表示右孩子)
+} PathEntry;
+
+/**
+ * Cursor抽象
+ */
+typedef struct {
+    Table* table;
+//    uint32_t row_num;
+    uint32_t page_num; // 光标指向页和页中的cell号，而不是row
+    uint32_t cell_num;
+    bool end_of_table; // 用来表示是否是最后一行
+    bool read_ahead; // 移动到下一个叶子时预读后面的叶子，范围扫描时使用
+    uint32_t prefetch_parent; // 上一次预读的叶子所在的父节点
+    uint32_t prefetch_end; // 父节点中已经预读到的孩子序号(不含)
+    uint32_t depth; // path中有效的层数
+    PathEntry path[BTREE_MAX_DEPTH]; // 从根到当前叶子的路径，分裂时使用
+    uint32_t upper_bound; // 当前叶子能容纳的最大key，下一个叶子从upper_bound + 1开始
+    void* node; // 读取用的cursor所在叶子在快照中的内容，叶子被pin住，NULL表示没有
+    Snapshot snapshot; // 读取用的cursor看到的版本
+} Cursor;
+
+/**
+ * b树节点类型
+ */
+typedef enum { NODE_INTERNAL, NODE_LEAF, NODE_FREE_LIST } NodeType; // NODE_FREE_LIST是空闲页链表的页，不在b树里
+
+
+
+//////////////////////////////////////////// 常量
+
+// 记录每列占据的宽度
+static const uint32_t ID_SIZE = size_of_attribute(Row, id);
+static const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
+static const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
+// 计算每列的偏移
+static const uint32_t ID_OFFSET = 0;
+static const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
+static const uint32_t EMAIL_OFFSET __attribute__((unused)) = USERNAME_OFFSET + USERNAME_SIZE;
+// 计算一行的大小
+static const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+
+// 表属性
+static const uint32_t PAGE_SIZE = MYDB_PAGE_SIZE; // 每页大小，默认4096B
+//const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE; // 计算每页平均可以容纳多少行
+//const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES; // 计算整个表最多可以容纳多少行
+
+/**
+ * 节点的通用Header
+ */
+static const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t); // node_type 1字节
+static const uint32_t NODE_TYPE_OFFSET = 0;
+static const uint32_t IS_ROOT_SIZE = sizeof(uint8_t); // is_root 1字节
+static const uint32_t IS_ROOT_OFFSET = NODE_TYPE_OFFSET + NODE_TYPE_SIZE;
+static const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t); // parent_pointer 4字节
+static const uint32_t PARENT_POINTER_OFFSET __attribute__((unused)) = IS_ROOT_OFFSET + IS_ROOT_SIZE;
+static const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+
+/**
+ * 叶子结点Header
+ */
+static const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t); // leaf_node_num 4字节
+static const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
+static const uint32_t LEAF_NODE_CONTENT_START_SIZE = sizeof(PageOffset); // cell内容区的起始位置 2字节(64KB的页是4字节)
+static const uint32_t LEAF_NODE_CONTENT_START_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
+static const uint32_t LEAF_NODE_BASE_KEY_SIZE = sizeof(uint32_t); // 页内key的基准值 4字节
+static const uint32_t LEAF_NODE_BASE_KEY_OFFSET = LEAF_NODE_CONTENT_START_OFFSET + LEAF_NODE_CONTENT_START_SIZE;
+static const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_CONTENT_START_SIZE +
+        LEAF_NODE_BASE_KEY_SIZE;
+
+/**
+ * 叶子节点Body：slotted page
+ * header之后是按key排序的slot数组，每个slot是cell在页内的偏移；
+ * cell从页尾向前分配，slot数组和cell内容区之间是空闲空间。
+ * cell是 key(varint) + username长度(1字节) + username + email长度(1字节) + email，只存实际长度
+ * key存的是和header中base_key的差值，用varint编码，相邻的id通常只要1个字节
+ */
+static const uint32_t LEAF_NODE_SLOT_SIZE = sizeof(PageOffset); // slot 2字节(64KB的页是4字节)
+static const uint32_t LEAF_NODE_KEY_SIZE = 5; // varint编码的key最长5字节
+static const uint32_t LEAF_NODE_LENGTH_SIZE = sizeof(uint8_t); // 变长字段的长度前缀 1字节
+static const uint32_t LEAF_NODE_MAX_CELL_SIZE = LEAF_NODE_KEY_SIZE + 2 * LEAF_NODE_LENGTH_SIZE +
+        COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE; // 最长的cell
+static const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE; // 除去header剩下的空间
+static const uint32_t LEAF_NODE_MIN_USED = LEAF_NODE_SPACE_FOR_CELLS / 4; // 删除之后用量低于它的叶子和兄弟合并或者重新分配
+
+/**
+ * 内部节点Header
+ */
+static const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t); // num_keys 4字节
+static const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
+static const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t); // right_child 4字节
+static const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
+static const uint32_t INTERNAL_NODE_BASE_KEY_SIZE = sizeof(uint32_t); // 页内key的基准值 4字节
+static const uint32_t INTERNAL_NODE_BASE_KEY_OFFSET = INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+static const uint32_t INTERNAL_NODE_KEY_WIDTH_SIZE = sizeof(uint8_t); // 每个key占的字节数 1字节
+static const uint32_t INTERNAL_NODE_KEY_WIDTH_OFFSET = INTERNAL_NODE_BASE_KEY_OFFSET + INTERNAL_NODE_BASE_KEY_SIZE;
+static const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE +
+        INTERNAL_NODE_BASE_KEY_SIZE + INTERNAL_NODE_KEY_WIDTH_SIZE;
+
+/**
+ * 内部节点Body
+ * 每个cell是 (child, key)，key是child子树中最大的key，最右边的孩子单独存在header的right_child里
+ * key存的是和base_key的差值，按整个节点里最大的差值定宽(1~4字节)，这样二分查找时仍然可以按下标直接定位
+ */
+static const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t); // child 4字节
+static const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t); // key最宽4字节
+static const uint32_t INTERNAL_NODE_MAX_CELLS = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / (INTERNAL_NODE_CHILD_SIZE + 1); // key宽1字节时可以容纳的key数量
+static const uint32_t INTERNAL_NODE_MIN_KEYS = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) /
+        (INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE) / 4; // 删除之后key数低于它的内部节点和兄弟合并或者重新分配
+
+/**
+ * 数据库文件头(meta页)：第0页和第1页轮流写，事务号是奇数时写第1页，
+ * 打开时用校验和正确、事务号最大的一页。b树从第2页开始
+ */
+static const char META_MAGIC[8] = "mydb"; // 不足8字节的部分补'\0'
+static const uint32_t META_MAGIC_SIZE = sizeof(META_MAGIC);
+static const uint32_t META_MAGIC_OFFSET = 0;
+static const uint32_t META_FORMAT_VERSION_SIZE = sizeof(uint32_t); // 文件格式版本 4字节
+static const uint32_t META_FORMAT_VERSION_OFFSET = META_MAGIC_OFFSET + META_MAGIC_SIZE;
+static const uint32_t META_PAGE_SIZE_SIZE = sizeof(uint32_t); // 页大小 4字节
+static const uint32_t META_PAGE_SIZE_OFFSET = META_FORMAT_VERSION_OFFSET + META_FORMAT_VERSION_SIZE;
+static const uint32_t META_FLAGS_SIZE = sizeof(uint32_t); // 标志位 4字节
+static const uint32_t META_FLAGS_OFFSET = META_PAGE_SIZE_OFFSET + META_PAGE_SIZE_SIZE;
+static const uint32_t META_TXN_ID_SIZE = sizeof(uint64_t); // 事务号 8字节
+static const uint32_t META_TXN_ID_OFFSET = META_FLAGS_OFFSET + META_FLAGS_SIZE;
+static const uint32_t META_ROOT_PAGE_SIZE = sizeof(uint32_t); // 根页 4字节
+static const uint32_t META_ROOT_PAGE_OFFSET = META_TXN_ID_OFFSET + META_TXN_ID_SIZE;
+static const uint32_t META_NUM_PAGES_SIZE = sizeof(uint32_t); // 文件的页数 4字节
+static const uint32_t META_NUM_PAGES_OFFSET = META_ROOT_PAGE_OFFSET + META_ROOT_PAGE_SIZE;
+static const uint32_t META_FREE_LIST_SIZE = sizeof(uint32_t); // 空闲页链表的第一页，0表示没有 4字节
+static const uint32_t META_FREE_LIST_OFFSET = META_NUM_PAGES_OFFSET + META_NUM_PAGES_SIZE;
+static const uint32_t META_CHECKSUM_SIZE = sizeof(uint32_t); // 前面所有字段的校验和 4字节
+static const uint32_t META_CHECKSUM_OFFSET = META_FREE_LIST_OFFSET + META_FREE_LIST_SIZE;
+static const uint32_t META_SIZE = META_CHECKSUM_OFFSET + META_CHECKSUM_SIZE;
+static const uint32_t META_PAGES = 2; // meta页的个数
+static const uint32_t META_FORMAT_VERSION = 1; // 当前的文件格式版本，格式不兼容地修改时加一
+static const uint32_t META_FLAG_COPY_ON_WRITE = 1 << 0; // 写时复制模式的文件
+
+/**
+ * 空闲页链表：meta页中的free_list_head指向第一页，每页记录下一页和一组空闲页的编号。
+ * 空闲页本身的内容没有意义；链表只在持久化之前整体重写一次
+ */
+static const uint32_t FREE_LIST_NEXT_SIZE = sizeof(uint32_t); // 下一页，0表示没有 4字节
+static const uint32_t FREE_LIST_NEXT_OFFSET = COMMON_NODE_HEADER_SIZE;
+static const uint32_t FREE_LIST_COUNT_SIZE = sizeof(uint32_t); // 这一页记录的空闲页数 4字节
+static const uint32_t FREE_LIST_COUNT_OFFSET = FREE_LIST_NEXT_OFFSET + FREE_LIST_NEXT_SIZE;
+static const uint32_t FREE_LIST_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + FREE_LIST_NEXT_SIZE + FREE_LIST_COUNT_SIZE;
+static const uint32_t FREE_LIST_MAX_PAGES = (PAGE_SIZE - FREE_LIST_HEADER_SIZE) / sizeof(uint32_t); // 一页能记录的空闲页数
+
+
+//////////////////////////////////////////// 方法
+
+/**
+ * 打印数据库常数
+ */
+static void print_constants() {
+    printf("PAGE_SIZE: %d\n", PAGE_SIZE);
+    printf("ROW_SIZE: %d\n", ROW_SIZE);
+    printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_SLOT_SIZE: %d\n", LEAF_NODE_SLOT_SIZE);
+    printf("LEAF_NODE_MAX_CELL_SIZE: %d\n", LEAF_NODE_MAX_CELL_SIZE);
+    printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELLS);
+}
+
+/**
+ * 获取节点类型
+ * @param node
+ * @return 节点类型
+ */
+static NodeType get_node_type(void* node) {
+    uint8_t value = *((uint8_t*)(node + NODE_TYPE_OFFSET));
+    return (NodeType)value;
+}
+
+/**
+ * 设置节点类型
+ * @param node
+ * @param type
+ */
+static void set_node_type(void* node, NodeType type) {
+    *((uint8_t*)(node + NODE_TYPE_OFFSET)) = (uint8_t)type;
+}
+
+/**
+ * 判断节点是否为根节点
+ * @param node
+ * @return
+ */
+static bool is_node_root(void* node) {
+    return (bool)*((uint8_t*)(node + IS_ROOT_OFFSET));
+}
+
+/**
+ * 设置节点是否为根节点
+ * @param node
+ * @param is_root
+ */
+static void set_node_root(void* node, bool is_root) {
+    *((uint8_t*)(node + IS_ROOT_OFFSET)) = (uint8_t)is_root;
+}
+
+/**
+ * 获取叶子节点中的cell个数
+ * @param node
+ * @return 叶子结点个数
+ */
+static uint32_t* leaf_node_num_cells(void* node) {
+    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+}
+
+/**
+ * 获取叶子节点cell内容区的起始位置，内容区从这里一直到页尾
+ * @param node
+ * @return
+ */
+static PageOffset* leaf_node_content_start(void* node) {
+    return node + LEAF_NODE_CONTENT_START_OFFSET;
+}
+
+/**
+ * 获取第cell_num个slot，slot中存放cell在页内的偏移
+ * @param node
+ * @param cell_num
+ * @return
+ */
+static PageOffset* leaf_node_slot(void* node, uint32_t cell_num) {
+    return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_SLOT_SIZE;
+}
+
+/**
+ * 获取叶子结点中第cell_num个cell
+ * @param node
+ * @param cell_num
+ * @return cell
+ */
+static void* leaf_node_cell(void* node, uint32_t cell_num) {
+    return node + *leaf_node_slot(node, cell_num);
+}
+
+/**
+ * 获取叶子节点的key基准值，cell里的key都是相对它的差值
+ * @param node
+ * @return
+ */
+static uint32_t* leaf_node_base_key(void* node) {
+    return node + LEAF_NODE_BASE_KEY_OFFSET;
+}
+
+/**
+ * varint编码后的长度
+ * @param value
+ * @return 字节数(1~5)
+ */
+static uint32_t varint_size(uint32_t value) {
+    uint32_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * varint编码：每个字节存7位，最高位表示后面还有没有字节
+ * @param value
+ * @param destination 至少LEAF_NODE_KEY_SIZE个字节
+ * @return 写入的字节数
+ */
+static uint32_t varint_encode(uint32_t value, void* destination) {
+    uint8_t* bytes = destination;
+    uint32_t size = 0;
+    while (value >= 0x80) {
+        bytes[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = (uint8_t)value;
+    return size;
+}
+
+/**
+ * varint解码
+ * @param source
+ * @param value 解码出来的值
+ * @return 读取的字节数
+ */
+static uint32_t varint_decode(const void* source, uint32_t* value) {
+    const uint8_t* bytes = source;
+    uint32_t result = 0;
+    uint32_t size = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = bytes[size++];
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value = result;
+    return size;
+}
+
+/**
+ * 获取第cell_num个cell的key，读取时才从差值解码
+ * @param node
+ * @param cell_num
+ * @return key
+ */
+static uint32_t leaf_node_key(void* node, uint32_t cell_num) {
+    uint32_t delta;
+    varint_decode(leaf_node_cell(node, cell_num), &delta);
+    return *leaf_node_base_key(node) + delta;
+}
+
+/**
+ * cell的长度
+ * @param cell
+ * @return 字节数
+ */
+static uint32_t leaf_cell_size(void* cell) {
+    uint32_t delta;
+    uint32_t key_size = varint_decode(cell, &delta);
+    uint8_t* lengths = cell + key_size;
+    uint8_t username_length = lengths[0];
+    uint8_t email_length = lengths[LEAF_NODE_LENGTH_SIZE + username_length];
+    return key_size + 2 * LEAF_NODE_LENGTH_SIZE + username_length + email_length;
+}
+
+/**
+ * 叶子节点的空闲空间：slot数组末尾到cell内容区之间
+ * @param node
+ * @return 字节数
+ */
+static uint32_t leaf_node_free_space(void* node) {
+    return *leaf_node_content_start(node) - LEAF_NODE_HEADER_SIZE - *leaf_node_num_cells(node) * LEAF_NODE_SLOT_SIZE;
+}
+
+/**
+ * 初始化leaf node（清空叶子结点）
+ * @param node
+ * @return
+ */
+static void initialize_leaf_node(void* node){
+    set_node_type(node, NODE_LEAF);
+    set_node_root(node, false);
+    *leaf_node_num_cells(node) = 0;
+    *leaf_node_content_start(node) = PAGE_SIZE;
+    *leaf_node_base_key(node) = 0;
+}
+
+/**
+ * 获取内部节点中key的个数
+ * @param node
+ * @return key个数的地址
+ */
+static uint32_t* internal_node_num_keys(void* node) {
+    return node + INTERNAL_NODE_NUM_KEYS_OFFSET;
+}
+
+/**
+ * 获取内部节点最右边的孩子
+ * @param node
+ * @return 右孩子页编号的地址
+ */
+static uint32_t* internal_node_right_child(void* node) {
+    return node + INTERNAL_NODE_RIGHT_CHILD_OFFSET;
+}
+
+/**
+ * 获取内部节点的key基准值
+ * @param node
+ * @return
+ */
+static uint32_t* internal_node_base_key(void* node) {
+    return node + INTERNAL_NODE_BASE_KEY_OFFSET;
+}
+
+/**
+ * 获取内部节点中每个key占的字节数
+ * @param node
+ * @return
+ */
+static uint8_t* internal_node_key_width(void* node) {
+    return node + INTERNAL_NODE_KEY_WIDTH_OFFSET;
+}
+
+/**
+ * 存下一个差值需要的字节数
+ * @param delta
+ * @return 1~4
+ */
+static uint32_t internal_key_width(uint32_t delta) {
+    uint32_t width = 1;
+    while (width < INTERNAL_NODE_KEY_SIZE && (delta >> (8 * width)) != 0) {
+        width++;
+    }
+    return width;
+}
+
+/**
+ * key宽width字节时内部节点能容纳的key数量
+ * @param width
+ * @return
+ */
+static uint32_t internal_node_max_keys(uint32_t width) {
+    return (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / (INTERNAL_NODE_CHILD_SIZE + width);
+}
+
+/**
+ * 获取内部节点中第cell_num个cell
+ * @param node
+ * @param cell_num
+ * @return cell
+ */
+static uint32_t* internal_node_cell(void* node, uint32_t cell_num) {
+    uint32_t cell_size = INTERNAL_NODE_CHILD_SIZE + *internal_node_key_width(node);
+    return node + INTERNAL_NODE_HEADER_SIZE + cell_num * cell_size;
+}
+
+/**
+ * 获取内部节点第child_num个孩子，child_num等于num_keys时返回右孩子
+ * @param node
+ * @param child_num
+ * @return 孩子页编号的地址
+ */
+static uint32_t* internal_node_child(void* node, uint32_t child_num) {
+    uint32_t num_keys = *internal_node_num_keys(node);
+    assert(child_num <= num_keys); // 调用者算出的孩子序号不会越界
+    if (child_num == num_keys) {
+        return internal_node_right_child(node);
+    } else {
+        return internal_node_cell(node, child_num);
+    }
+}
+
+/**
+ * 获取内部节点第key_num个key，差值按小端读出来再加上基准值
+ * @param node
+ * @param key_num
+ * @return key
+ */
+static uint32_t internal_node_key(void* node, uint32_t key_num) {
+    uint8_t* bytes = (void*)internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
+    uint32_t width = *internal_node_key_width(node);
+    uint32_t delta = 0;
+    for (uint32_t i = 0; i < width; i++) {
+        delta |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return *internal_node_base_key(node) + delta;
+}
+
+/**
+ * 初始化内部节点
+ * @param node
+ */
+static void initialize_internal_node(void* node) {
+    set_node_type(node, NODE_INTERNAL);
+    set_node_root(node, false);
+    *internal_node_num_keys(node) = 0;
+    *internal_node_base_key(node) = 0;
+    *internal_node_key_width(node) = INTERNAL_NODE_KEY_SIZE;
+}
+
+/**
+ * 用一组有序的key和孩子重写内部节点，基准值取最小的key，key宽度按最大差值决定
+ * 调用前要确认num_keys不超过internal_node_max_keys
+ * @param node 已经初始化的内部节点
+ * @param children num_keys + 1个孩子，最后一个是右孩子
+ * @param keys num_keys个key
+ * @param num_keys
+ */
+static void internal_node_fill(void* node, uint32_t* children, uint32_t* keys, uint32_t num_keys) {
+    uint32_t base_key = num_keys > 0 ? keys[0] : 0;
+    uint32_t width = num_keys > 0 ? internal_key_width(keys[num_keys - 1] - base_key) : INTERNAL_NODE_KEY_SIZE;
+    *internal_node_num_keys(node) = num_keys;
+    *internal_node_base_key(node) = base_key;
+    *internal_node_key_width(node) = width;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        uint8_t* cell = (void*)internal_node_cell(node, i);
+        uint32_t delta = keys[i] - base_key;
+        memcpy(cell, &children[i], INTERNAL_NODE_CHILD_SIZE);
+        for (uint32_t b = 0; b < width; b++) {
+            cell[INTERNAL_NODE_CHILD_SIZE + b] = (uint8_t)(delta >> (8 * b));
+        }
+    }
+    *internal_node_right_child(node) = children[num_keys];
+}
+
+/**
+ * 把内部节点的孩子和key读到数组里，internal_node_fill的逆过程
+ * @param node
+ * @param children 至少num_keys + 1个位置，最后一个是右孩子
+ * @param keys 至少num_keys个位置
+ * @return num_keys
+ */
+static uint32_t internal_node_unpack(void* node, uint32_t* children, uint32_t* keys) {
+    uint32_t num_keys = *internal_node_num_keys(node);
+    for (uint32_t i = 0; i < num_keys; i++) {
+        children[i] = *internal_node_cell(node, i);
+        keys[i] = internal_node_key(node, i);
+    }
+    children[num_keys] = *internal_node_right_child(node);
+    return num_keys;
+}
+
+/**
+ * 在内部节点中二分查找key应该下降到的孩子
+ * key[i]是第i个孩子中最大的key，所以找第一个大于等于key的位置
+ * @param node
+ * @param key
+ * @return 孩子序号，等于num_keys时表示右孩子
+ */
+static uint32_t internal_node_find_child(void* node, uint32_t key) {
+    uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t min_index = 0;
+    uint32_t max_index = num_keys; // 孩子比key多一个
+    while (min_index != max_index) {
+        uint32_t index = (min_index + max_index) / 2;
+        uint32_t key_to_right = internal_node_key(node, index);
+        if (key_to_right >= key) {
+            max_index = index;
+        } else {
+            min_index = index + 1;
+        }
+    }
+    return min_index;
+}
+
+/**
+ * 计算crc32校验和，用来发现wal末尾写了一半的记录
+ * @param data
+ * @param length
+ * @return
+ */
+static uint32_t crc32(const void* data, uint32_t length) {
+    static uint32_t table[256];
+    static bool table_ready = false;
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    const uint8_t* bytes = data;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/**
+ * wal记录头：payload长度(4字节) + crc32(4字节) + 记录类型(1字节)，之后是payload
+ */
+static const uint32_t WAL_RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+
+/**
+ * 打开数据库对应的wal文件(数据库文件名加上-wal)
+ * @param db_filename
+ * @param group_size 组提交大小
+ * @return 不能打开wal文件时返回NULL
+ */
+static Wal* wal_open(const char* db_filename, uint32_t group_size) {
+    char* filename = malloc(strlen(db_filename) + 5);
+    sprintf(filename, "%s-wal", db_filename);
+    int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    if (fd == -1) {
+        free(filename);
+        return NULL;
+    }
+
+    Wal* wal = malloc(sizeof(Wal));
+    wal->file_descriptor = fd;
+    wal->filename = filename;
+    wal->buffer_capacity = 64 * 1024;
+    wal->buffer = malloc(wal->buffer_capacity);
+    wal->buffer_length = 0;
+    wal->file_length = lseek(fd, 0, SEEK_END);
+    wal->pending_commits = 0;
+    wal->group_size = group_size > 0 ? group_size : 1;
+    wal->keep_records = false;
+    return wal;
+}
+
+/**
+ * 在wal缓冲区中追加一条记录，记录在wal_sync时才写进文件
+ * @param wal
+ * @param type 记录类型
+ * @param payload
+ * @param length payload长度
+ */
+static void wal_append(Wal* wal, WalRecordType type, const void* payload, uint32_t length) {
+    uint32_t record_size = WAL_RECORD_HEADER_SIZE + length;
+    if (wal->buffer_length + record_size > wal->buffer_capacity) {
+        while (wal->buffer_length + record_size > wal->buffer_capacity) {
+            wal->buffer_capacity *= 2;
+        }
+        wal->buffer = realloc(wal->buffer, wal->buffer_capacity);
+    }
+
+    char* record = wal->buffer + wal->buffer_length;
+    uint8_t type_byte = type;
+    // crc覆盖类型和payload
+    memcpy(record + 2 * sizeof(uint32_t), &type_byte, sizeof(uint8_t));
+    if (length > 0) {
+        memcpy(record + WAL_RECORD_HEADER_SIZE, payload, length);
+    }
+    uint32_t crc = crc32(record + 2 * sizeof(uint32_t), sizeof(uint8_t) + length);
+    memcpy(record, &length, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), &crc, sizeof(uint32_t));
+    wal->buffer_length += record_size;
+}
+
+/**
+ * 把缓冲区中的记录写进wal文件并fdatasync，之后这些记录对应的事务就是持久的
+ * @param wal
+ * @param stats
+ * @return 写入或者fdatasync失败时返回false，记录留在缓冲区里
+ */
+static bool wal_sync(Wal* wal, PagerStats* stats) {
+    if (wal->buffer_length == 0 && wal->pending_commits == 0) {
+        return true;
+    }
+    uint32_t written = 0;
+    while (written < wal->buffer_length) {
+        ssize_t result = pwrite(wal->file_descriptor, wal->buffer + written,
+                                wal->buffer_length - written, wal->file_length + written);
+        if (result == -1) {
+            return false;
+        }
+        written += result;
+    }
+    if (fdatasync(wal->file_descriptor) == -1) {
+        return false;
+    }
+    wal->file_length += wal->buffer_length;
+    wal->buffer_length = 0;
+    wal->pending_commits = 0;
+    stats->wal_syncs++;
+    return true;
+}
+
+/**
+ * 提交一个事务：组提交，攒够group_size个提交才做一次fdatasync。
+ * group_size大于1时还没fdatasync的提交已经返回成功，崩溃时可能丢失，调用者用db_sync确认持久化
+ * @param wal
+ * @param stats
+ * @return wal_sync失败时返回false
+ */
+static bool wal_commit(Wal* wal, PagerStats* stats) {
+    wal->pending_commits++;
+    if (wal->pending_commits >= wal->group_size) {
+        return wal_sync(wal, stats);
+    }
+    return true;
+}
+
+/**
+ * checkpoint之后清空wal
+ * @param wal
+ * @return 失败时返回false，wal保持原样
+ */
+static bool wal_truncate(Wal* wal) {
+    if (ftruncate(wal->file_descriptor, 0) == -1) {
+        return false;
+    }
+    wal->file_length = 0;
+    wal->buffer_length = 0;
+    wal->pending_commits = 0;
+    return true;
+}
+
+/**
+ * 关闭wal，正常关闭时删除wal文件
+ * @param wal
+ * @param remove 是否删除wal文件
+ */
+static void wal_close(Wal* wal, bool remove) {
+    close(wal->file_descriptor);
+    if (remove) {
+        unlink(wal->filename);
+    }
+    free(wal->filename);
+    free(wal->buffer);
+    free(wal);
+}
+
+/**
+ * 读取offset处的一条记录
+ * @param wal
+ * @param offset 记录在文件中的位置
+ * @param type 输出记录类型
+ * @param payload 输出payload，调用者负责free
+ * @param length 输出payload长度
+ * @return 下一条记录的位置，记录不完整或者校验失败时返回0
+ */
+static uint64_t wal_read_record(Wal* wal, uint64_t offset, WalRecordType* type, void** payload, uint32_t* length) {
+    char header[WAL_RECORD_HEADER_SIZE];
+    if (offset + WAL_RECORD_HEADER_SIZE > wal->file_length ||
+        pread(wal->file_descriptor, header, WAL_RECORD_HEADER_SIZE, offset) != WAL_RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t crc;
+    memcpy(length, header, sizeof(uint32_t));
+    memcpy(&crc, header + sizeof(uint32_t), sizeof(uint32_t));
+    if (offset + WAL_RECORD_HEADER_SIZE + *length > wal->file_length) {
+        // 崩溃时只写了一半
+        return 0;
+    }
+
+    char* data = malloc(sizeof(uint8_t) + *length);
+    data[0] = header[2 * sizeof(uint32_t)];
+    if (pread(wal->file_descriptor, data + 1, *length, offset + WAL_RECORD_HEADER_SIZE) != (ssize_t)*length ||
+        crc32(data, sizeof(uint8_t) + *length) != crc) {
+        free(data);
+        return 0;
+    }
+    *type = (WalRecordType)(uint8_t)data[0];
+    memmove(data, data + 1, *length);
+    *payload = data;
+    return offset + WAL_RECORD_HEADER_SIZE + *length;
+}
+
+/**
+ * 把wal中[start, end)之间的页镜像写回数据库文件
+ * @param wal
+ * @param db_fd 数据库文件
+ * @param start
+ * @param end
+ * @return 写数据库文件失败时返回false
+ */
+static bool wal_apply_pages(Wal* wal, int db_fd, uint64_t start, uint64_t end) {
+    WalRecordType type;
+    void* payload;
+    uint32_t length;
+    uint64_t offset = start;
+    while (offset < end) {
+        offset = wal_read_record(wal, offset, &type, &payload, &length);
+        if (type == WAL_RECORD_PAGE) {
+            uint32_t page_num;
+            memcpy(&page_num, payload, sizeof(uint32_t));
+            if (pwrite(db_fd, payload + sizeof(uint32_t), PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != PAGE_SIZE) {
+                free(payload);
+                return false;
+            }
+        }
+        free(payload);
+    }
+    return true;
+}
+
+/**
+ * 崩溃恢复的第一步：把wal中每个完整checkpoint的页镜像按顺序写回数据库文件，
+ * 这样即使checkpoint写到一半崩溃，数据库文件也会回到checkpoint完成时的一致状态。
+ * 没有CHECKPOINT记录结尾的页镜像说明那次checkpoint还没开始写数据库文件，直接忽略。
+ * 插入记录在db_open中重放
+ * @param wal
+ * @param db_fd 数据库文件
+ * @return 写回或者fsync失败时返回false
+ */
+static bool wal_recover_pages(Wal* wal, int db_fd) {
+    uint64_t offset = 0;
+    uint64_t segment_start = 0;
+    bool applied = false;
+    WalRecordType type;
+    void* payload;
+    uint32_t length;
+    while (true) {
+        uint64_t next = wal_read_record(wal, offset, &type, &payload, &length);
+        if (next == 0) {
+            break;
+        }
+        free(payload);
+        if (type == WAL_RECORD_CHECKPOINT) {
+            if (!wal_apply_pages(wal, db_fd, segment_start, offset)) {
+                return false;
+            }
+            segment_start = next;
+            applied = true;
+        }
+        offset = next;
+    }
+    // 后面不完整的记录直接丢掉
+    wal->file_length = offset;
+    if (ftruncate(wal->file_descriptor, offset) == -1) {
+        return false;
+    }
+    return !applied || fsync(db_fd) != -1;
+}
+
+#ifdef HAVE_IO_URING
+/**
+ * io_uring的提交队列和完成队列，两个队列都和内核共享内存
+ */
+struct Ring {
+    int fd;
+    uint32_t entries;
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    struct io_uring_sqe* sqes;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    uint32_t to_submit; // 已经放进提交队列、还没通知内核的请求数
+    uint32_t inflight; // 已经提交、还没收到完成的请求数
+};
+
+/**
+ * 创建io_uring，内核不支持(或者被禁用)时返回NULL，调用者退回同步I/O
+ * @param entries 队列长度
+ * @return
+ */
+static Ring* ring_open(uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Ring* ring = malloc(sizeof(Ring));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        // 两个队列共用一次映射
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        // 映射不了就当作不支持，退回同步I/O
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        if (ring->cq_ring != ring->sq_ring && ring->cq_ring != MAP_FAILED) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        if (ring->sq_ring != MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        }
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    char* sq = ring->sq_ring;
+    ring->sq_head = (uint32_t*)(sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+    char* cq = ring->cq_ring;
+    ring->cq_head = (uint32_t*)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->to_submit = 0;
+    ring->inflight = 0;
+    return ring;
+}
+
+/**
+ * 队列中还能放多少个请求。完成队列是提交队列的两倍长，
+ * 只要没完成的请求不超过entries个，完成队列就不会溢出
+ * @param ring
+ * @return
+ */
+static uint32_t ring_space(Ring* ring) {
+    return ring->entries - ring->inflight - ring->to_submit;
+}
+
+/**
+ * 还没有完成的请求数(包括还没提交的)
+ * @param ring
+ * @return
+ */
+static uint32_t ring_busy(Ring* ring) {
+    return ring->inflight + ring->to_submit;
+}
+
+/**
+ * 在提交队列中放一个请求，调用者保证ring_space大于0
+ * @param ring
+ * @param opcode IORING_OP_READ
+ * @param fd
+ * @param addr 读的缓冲区，或者写的iovec数组
+ * @param length 读的字节数，或者iovec个数
+ * @param offset 文件中的位置
+ * @param user_data 完成时原样返回
+ */
+static void ring_prepare(Ring* ring, uint8_t opcode, int fd, void* addr, uint32_t length, uint64_t offset,
+                         uint64_t user_data) {
+    uint32_t tail = *ring->sq_tail;
+    uint32_t index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &(ring->sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    // 内核看到新的tail之前，sqe必须已经写好
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+/**
+ * 把提交队列中的请求交给内核，wait为true时等到至少有一个请求完成
+ * @param ring
+ * @param wait
+ * @return 内核拒绝提交时返回false
+ */
+static bool ring_enter(Ring* ring, bool wait) {
+    uint32_t flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    if (ring->to_submit == 0 && !wait) {
+        return true;
+    }
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait ? 1 : 0, flags, NULL, 0);
+    } while (submitted < 0 && (errno == EINTR || errno == EAGAIN));
+    if (submitted < 0) {
+        return false;
+    }
+    ring->inflight += submitted;
+    ring->to_submit -= submitted;
+    return true;
+}
+
+/**
+ * 从完成队列中取出一个完成的请求
+ * @param ring
+ * @param user_data 输出请求的user_data
+ * @param result 输出请求的结果，和对应的系统调用返回值相同
+ * @return 完成队列为空时返回false
+ */
+static bool ring_complete(Ring* ring, uint64_t* user_data, int32_t* result) {
+    uint32_t head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    struct io_uring_cqe* cqe = &(ring->cqes[head & *ring->cq_mask]);
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    ring->inflight--;
+    return true;
+}
+
+static void ring_close(Ring* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    free(ring);
+}
+#else
+// 没有io_uring的平台：ring_open总是返回NULL，下面的函数不会被调用
+static Ring* ring_open(uint32_t entries) { return NULL; }
+static uint32_t ring_space(Ring* ring) { return 0; }
+static uint32_t ring_busy(Ring* ring) { return 0; }
+static void ring_prepare(Ring* ring, uint8_t opcode, int fd, void* addr, uint32_t length, uint64_t offset,
+                         uint64_t user_data) {}
+static bool ring_enter(Ring* ring, bool wait) { return true; }
+static bool ring_complete(Ring* ring, uint64_t* user_data, int32_t* result) { return false; }
+static void ring_close(Ring* ring) {}
+#define IORING_OP_READ 0
+#endif
+
+
+/**
+ * 记下I/O失败或者损坏，只保留第一次的错误。之后的语句都返回它，db_close也不再写数据库文件。
+ * 读写都可能调用，用原子操作，不要求持有锁
+ * @param pager
+ * @param error EXECUTE_IO_ERROR或者EXECUTE_CORRUPT
+ */
+static void pager_fail(Pager* pager, ExecuteResult error) {
+    ExecuteResult expected = EXECUTE_SUCCESS;
+    __atomic_compare_exchange_n(&(pager->error), &expected, error, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * 之前发生过的错误
+ * @param pager
+ * @return 没有错误时返回EXECUTE_SUCCESS
+ */
+static ExecuteResult pager_error(Pager* pager) {
+    return __atomic_load_n(&(pager->error), __ATOMIC_RELAXED);
+}
+
+/**
+ * 把映射扩展到当前的文件长度。
+ * 用MAP_PRIVATE映射：对页的修改只留在进程里，仍然由pager_write_frame(以及wal的checkpoint)写回文件
+ * @param pager
+ * @return 映射失败时返回false，已经映射的部分不变，后面的页用pread读
+ */
+static bool pager_map_extend(Pager* pager) {
+    uint64_t length = pager->file_length;
+    if (length > PAGER_MMAP_RESERVE) {
+        length = PAGER_MMAP_RESERVE;
+    }
+    if (length <= pager->map_length) {
+        return true;
+    }
+    void* map = mmap(pager->map + pager->map_length, length - pager->map_length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, pager->file_descriptor, pager->map_length);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    pager->map_length = length;
+    return true;
+}
+
+/**
+ * 分配缓冲池的arena：匿名映射天然按页对齐，物理内存在第一次访问时才分配，
+ * linux上再提示内核用大页，减少TLB缺失
+ * @param size 字节数
+ * @return 分配失败时返回NULL
+ */
+static char* pager_arena_alloc(size_t size) {
+    void* arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    return arena;
+}
+
+/**
+ * meta页的校验和(FNV-1a)，写到一半的meta页校验和对不上
+ * @param meta
+ * @return
+ */
+static uint32_t meta_checksum(const char* meta) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < META_CHECKSUM_OFFSET; i++) {
+        hash ^= (uint8_t)meta[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * 解析一个meta页
+ * @param buffer meta页开头的META_SIZE字节
+ * @param meta
+ * @return magic和校验和都对时返回true
+ */
+static bool meta_decode(const char* buffer, Meta* meta) {
+    if (memcmp(buffer + META_MAGIC_OFFSET, META_MAGIC, META_MAGIC_SIZE) != 0 ||
+        *(uint32_t*)(buffer + META_CHECKSUM_OFFSET) != meta_checksum(buffer)) {
+        return false;
+    }
+    meta->format_version = *(uint32_t*)(buffer + META_FORMAT_VERSION_OFFSET);
+    meta->page_size = *(uint32_t*)(buffer + META_PAGE_SIZE_OFFSET);
+    meta->flags = *(uint32_t*)(buffer + META_FLAGS_OFFSET);
+    meta->txn_id = *(uint64_t*)(buffer + META_TXN_ID_OFFSET);
+    meta->root_page_num = *(uint32_t*)(buffer + META_ROOT_PAGE_OFFSET);
+    meta->num_pages = *(uint32_t*)(buffer + META_NUM_PAGES_OFFSET);
+    meta->free_list_head = *(uint32_t*)(buffer + META_FREE_LIST_OFFSET);
+    return true;
+}
+
+/**
+ * 读出两个meta页中校验和正确、事务号最大的一个。
+ * 第1个meta页的位置取决于创建文件时的页大小，所以每种可能的页大小都找一下，页大小和位置对得上才算数
+ * @param fd
+ * @param meta
+ * @return 有没有有效的meta页，新文件没有
+ */
+static bool meta_read(int fd, Meta* meta) {
+    char buffer[META_SIZE];
+    Meta candidate;
+    bool found = false;
+    for (uint32_t offset = 0; offset <= MYDB_MAX_PAGE_SIZE; offset = offset == 0 ? MYDB_MIN_PAGE_SIZE : offset * 2) {
+        if (pread(fd, buffer, META_SIZE, offset) != META_SIZE || !meta_decode(buffer, &candidate) ||
+            (offset != 0 && candidate.page_size != offset)) {
+            continue;
+        }
+        if (!found || candidate.txn_id > meta->txn_id) {
+            *meta = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * 检查文件头是不是这个版本能打开的格式
+ * @param meta
+ * @return
+ */
+static OpenResult meta_check(Meta* meta) {
+    if (meta->format_version != META_FORMAT_VERSION) {
+        return OPEN_UNSUPPORTED_VERSION;
+    }
+    if (meta->page_size != PAGE_SIZE) {
+        return OPEN_PAGE_SIZE_MISMATCH;
+    }
+    return OPEN_SUCCESS;
+}
+
+/**
+ * 在pager->meta_buffer中生成pager当前状态的meta页，事务号是pager->txn_id。
+ * 只在修改b树的线程中调用
+ * @param pager
+ * @return meta页
+ */
+static char* pager_encode_meta(Pager* pager) {
+    char* buffer = pager->meta_buffer;
+    memset(buffer, 0, PAGE_SIZE);
+    memcpy(buffer + META_MAGIC_OFFSET, META_MAGIC, META_MAGIC_SIZE);
+    *(uint32_t*)(buffer + META_FORMAT_VERSION_OFFSET) = META_FORMAT_VERSION;
+    *(uint32_t*)(buffer + META_PAGE_SIZE_OFFSET) = PAGE_SIZE;
+    *(uint32_t*)(buffer + META_FLAGS_OFFSET) = pager->copy_on_write ? META_FLAG_COPY_ON_WRITE : 0;
+    *(uint64_t*)(buffer + META_TXN_ID_OFFSET) = pager->txn_id;
+    *(uint32_t*)(buffer + META_ROOT_PAGE_OFFSET) = pager->committed_root;
+    *(uint32_t*)(buffer + META_NUM_PAGES_OFFSET) = pager->num_pages;
+    *(uint32_t*)(buffer + META_FREE_LIST_OFFSET) = pager->free_list_head;
+    *(uint32_t*)(buffer + META_CHECKSUM_OFFSET) = meta_checksum(buffer);
+    return buffer;
+}
+
+/**
+ * 把meta页写到第txn_id % 2页，另一个meta页还是上一次的状态，写到一半崩溃时打开会用另一个
+ * @param pager
+ * @param buffer pager_encode_meta生成的meta页
+ * @return 写入失败时返回false
+ */
+static bool pager_write_meta(Pager* pager, const char* buffer) {
+    off_t offset = (off_t)(pager->txn_id % META_PAGES) * PAGE_SIZE;
+    return pwrite(pager->file_descriptor, buffer, PAGE_SIZE, offset) == PAGE_SIZE;
+}
+
+/**
+ * 对打开的文件启用直接I/O：linux上是O_DIRECT，macOS上是F_NOCACHE
+ * @param fd
+ * @return 不支持时返回false
+ */
+static bool pager_enable_direct_io(int fd) {
+#if defined(O_DIRECT)
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) != -1;
+#elif defined(F_NOCACHE)
+    return fcntl(fd, F_NOCACHE, 1) != -1;
+#else
+    return false;
+#endif
+}
+
+/**
+ * pager_open失败时关闭已经打开的文件，wal保留给下次恢复
+ * @param fd
+ * @param wal 没有打开时是NULL
+ * @param result 输出失败的原因
+ * @param error
+ * @return NULL
+ */
+static Pager* pager_open_failed(int fd, Wal* wal, OpenResult* result, OpenResult error) {
+    if (wal != NULL) {
+        wal_close(wal, false);
+    }
+    close(fd);
+    *result = error;
+    return NULL;
+}
+
+/**
+ * 打开数据库文件
+ * @param filename
+ * @param options 打开选项
+ * @param result 输出打开的结果
+ * @return 失败时返回NULL
+ */
+static Pager* pager_open(const char* filename, DbOptions* options, OpenResult* result) {
+    // 打开文件
+    int fd = open(filename,
+                  O_RDWR |          // Read/Write模式
+                        O_CREAT,    // 如果文件不存在就创建
+                  S_IWUSR |         // 使用者(用户)写权限
+                        S_IRUSR     // 使用者(用户)读权限
+                  );
+    if (fd == -1) {
+        *result = OPEN_IO_ERROR;
+        return NULL;
+    }
+
+    // 读文件头，已有的文件是不是写时复制模式由文件头决定，不管选项
+    Meta meta;
+    bool has_meta = meta_read(fd, &meta);
+    OpenResult check = has_meta ? meta_check(&meta) : OPEN_SUCCESS;
+    if (check != OPEN_SUCCESS) {
+        return pager_open_failed(fd, NULL, result, check);
+    }
+    bool copy_on_write = has_meta ? (meta.flags & META_FLAG_COPY_ON_WRITE) != 0 : options->copy_on_write;
+    if (options->copy_on_write && !copy_on_write) {
+        return pager_open_failed(fd, NULL, result, OPEN_NOT_COPY_ON_WRITE);
+    }
+
+    Wal* wal = NULL;
+    if (options->use_wal && !copy_on_write) {
+        // 写时复制模式靠meta页保证崩溃一致，不需要wal
+        // 先用wal把数据库文件恢复到最近一次checkpoint的状态，再计算文件长度
+        wal = wal_open(filename, options->wal_group_size);
+        if (wal == NULL) {
+            return pager_open_failed(fd, NULL, result, OPEN_IO_ERROR);
+        }
+        if (!wal_recover_pages(wal, fd)) {
+            return pager_open_failed(fd, wal, result, OPEN_IO_ERROR);
+        }
+        // 恢复可能补写了meta页
+        has_meta = meta_read(fd, &meta);
+        check = has_meta ? meta_check(&meta) : OPEN_SUCCESS;
+        if (check != OPEN_SUCCESS) {
+            return pager_open_failed(fd, wal, result, check);
+        }
+    }
+    if (!has_meta && lseek(fd, 0, SEEK_END) > 0) {
+        return pager_open_failed(fd, wal, result, OPEN_NOT_A_DATABASE);
+    }
+
+    if (options->use_direct_io) {
+        // 恢复时写的页镜像没有对齐，所以恢复之后才打开直接I/O。
+        // 之后数据库文件的读写都以整页为单位，使用arena中按页对齐的帧
+        if (options->use_mmap) {
+            return pager_open_failed(fd, wal, result, OPEN_MMAP_WITH_DIRECT_IO);
+        }
+        if (!pager_enable_direct_io(fd)) {
+            return pager_open_failed(fd, wal, result, OPEN_DIRECT_IO_UNSUPPORTED);
+        }
+    }
+
+    // lseek(2) open(2) 括号里的2是对函数的分类，2代表是系统调用
+    // 1是普通命令比如ls  3是库函数 比如printf 4是特殊文件，比如/dev下的各种设备文件
+    // 获取文件的存储数据的长度
+    off_t file_length = lseek(fd, 0, SEEK_END);
+    if (copy_on_write && has_meta && file_length > (off_t)meta.num_pages * PAGE_SIZE) {
+        // 最后一次写meta之后写进文件的页没有被引用，是崩溃前没提交完的，截掉
+        if (ftruncate(fd, (off_t)meta.num_pages * PAGE_SIZE) == -1) {
+            return pager_open_failed(fd, wal, result, OPEN_IO_ERROR);
+        }
+        file_length = (off_t)meta.num_pages * PAGE_SIZE;
+    }
+    if (file_length % PAGE_SIZE != 0) {
+        // db文件大小不是pages的整数倍
+        return pager_open_failed(fd, wal, result, OPEN_CORRUPT);
+    }
+
+    uint32_t num_frames = options->num_frames;
+    if (num_frames < PAGER_MIN_FRAMES) {
+        num_frames = PAGER_MIN_FRAMES;
+    }
+    char* arena = pager_arena_alloc((size_t)num_frames * PAGE_SIZE);
+    if (arena == NULL) {
+        return pager_open_failed(fd, wal, result, OPEN_OUT_OF_MEMORY);
+    }
+    char* map = NULL;
+    if (options->use_mmap) {
+        // 一次预留足够大的地址空间，文件变长时在后面接着映射，已经交给调用者的指针不会失效
+        map = mmap(NULL, PAGER_MMAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED) {
+            munmap(arena, (size_t)num_frames * PAGE_SIZE);
+            return pager_open_failed(fd, wal, result, OPEN_OUT_OF_MEMORY);
+        }
+    }
+    char* meta_buffer;
+    if (posix_memalign((void**)&meta_buffer, PAGE_SIZE, PAGE_SIZE) != 0) {
+        munmap(arena, (size_t)num_frames * PAGE_SIZE);
+        if (map != NULL) {
+            munmap(map, PAGER_MMAP_RESERVE);
+        }
+        return pager_open_failed(fd, wal, result, OPEN_OUT_OF_MEMORY);
+    }
+
+    Pager* pager = malloc(sizeof(Pager));
+    pager->file_descriptor = fd;
+    pager->file_length = file_length;
+    pager->num_pages = (file_length / PAGE_SIZE);
+    pager->copy_on_write = copy_on_write;
+    if (has_meta) {
+        pager->txn_id = meta.txn_id;
+        pager->root_page_num = meta.root_page_num;
+        pager->free_list_head = meta.free_list_head;
+    } else {
+        // 新文件先留出meta页，根页在它们后面，初始化之后才写meta
+        pager->num_pages = META_PAGES;
+        pager->txn_id = 0;
+        pager->root_page_num = META_PAGES;
+        pager->free_list_head = 0;
+    }
+    pager->committed_root = pager->root_page_num;
+    pager->fresh_page_num = pager->num_pages;
+    pager->unsynced_commits = 0;
+    // 空闲页链表在db_open中读入
+    memset(&(pager->free_pages), 0, sizeof(PageList));
+    memset(&(pager->pending_free), 0, sizeof(PageList));
+    memset(&(pager->free_list_pages), 0, sizeof(PageList));
+    pager->free_list_dirty = false;
+    pager->reused_pages = NULL;
+    pager->reused_pages_size = 0;
+    pager->group_size = options->wal_group_size > 0 ? options->wal_group_size : 1;
+    pager->meta_buffer = meta_buffer;
+
+    pager->num_frames = num_frames;
+    pager->frames = malloc(sizeof(Frame) * num_frames);
+    pager->arena = arena;
+    pager->arena_frames = num_frames;
+    pager->partial_commit = false;
+    pager->free_frames = -1;
+    for (int32_t i = num_frames - 1; i >= 0; i--) {
+        // 所有帧一开始都是空闲的，按帧编号从小到大使用
+        pager->frames[i].data = NULL;
+        pager->frames[i].buffer = pager->arena + (size_t)i * PAGE_SIZE;
+        pager->frames[i].working = NULL;
+        pager->frames[i].mapped = false;
+        pager->frames[i].io_pending = false;
+        pager->frames[i].in_use = false;
+        pager->frames[i].pin_count = 0;
+        pager->frames[i].dirty = false;
+        pager->frames[i].referenced = false;
+        pager->frames[i].hash_next = pager->free_frames;
+        pager->free_frames = i;
+    }
+    pager->clock_hand = 0;
+    pager->num_dirty = 0;
+    pager->wal = wal;
+    memset(&(pager->stats), 0, sizeof(PagerStats));
+    pager->committed_version = 0;
+    pager->oldest_snapshot = NULL;
+    pager->newest_snapshot = NULL;
+    pager->retired_head = NULL;
+    pager->retired_tail = NULL;
+    pager->spare_buffers = NULL;
+    pager->pending = malloc(sizeof(int32_t) * num_frames);
+    pager->num_pending = 0;
+    pager->flushing = false;
+    pager->error = EXECUTE_SUCCESS;
+    pthread_cond_init(&(pager->flushed), NULL);
+    pthread_mutex_init(&(pager->mutex), NULL);
+
+    // 不支持io_uring时ring为NULL，不做预读
+    pager->ring = ring_open(PAGER_RING_ENTRIES);
+    // 预读的请求不会超过队列长度，也不能挤占太多帧
+    pager->read_ahead = options->read_ahead;
+    if (pager->read_ahead > PAGER_RING_ENTRIES) {
+        pager->read_ahead = PAGER_RING_ENTRIES;
+    }
+    if (pager->read_ahead > num_frames / 4) {
+        pager->read_ahead = num_frames / 4;
+    }
+    pager->map = map;
+    pager->map_length = 0;
+    if (map != NULL) {
+        // 映射失败的部分用pread读
+        pager_map_extend(pager);
+    }
+
+    // 桶数取不小于帧数的2的幂，平均每个桶不到一帧
+    pager->num_buckets = 1;
+    while (pager->num_buckets < num_frames) {
+        pager->num_buckets <<= 1;
+    }
+    pager->buckets = malloc(sizeof(int32_t) * pager->num_buckets);
+    pager->versions = malloc(sizeof(PageVersions*) * pager->num_buckets);
+    for (uint32_t i = 0; i < pager->num_buckets; i++) {
+        pager->buckets[i] = -1;
+        pager->versions[i] = NULL;
+    }
+    *result = OPEN_SUCCESS;
+    return pager;
+}
+
+/**
+ * 计算页编号在页表中的桶
+ * @param pager
+ * @param page_num
+ * @return 桶编号
+ */
+static uint32_t pager_bucket(Pager* pager, uint32_t page_num) {
+    // 乘法哈希，把连续的页编号打散
+    return (page_num * 2654435761u) & (pager->num_buckets - 1);
+}
+
+/**
+ * 在页表中查找页所在的帧
+ * @param pager
+ * @param page_num
+ * @return 帧编号，不在缓冲池中时返回-1
+ */
+static int32_t pager_lookup(Pager* pager, uint32_t page_num) {
+    int32_t frame_num = pager->buckets[pager_bucket(pager, page_num)];
+    while (frame_num != -1 && pager->frames[frame_num].page_num != page_num) {
+        frame_num = pager->frames[frame_num].hash_next;
+    }
+    return frame_num;
+}
+
+/**
+ * 从页表中删除一帧
+ * @param pager
+ * @param frame_num
+ */
+static void pager_hash_remove(Pager* pager, int32_t frame_num) {
+    int32_t* link = &(pager->buckets[pager_bucket(pager, pager->frames[frame_num].page_num)]);
+    while (*link != frame_num) {
+        link = &(pager->frames[*link].hash_next);
+    }
+    *link = pager->frames[frame_num].hash_next;
+    pager->frames[frame_num].hash_next = -1;
+}
+
+/**
+ * 分配一页内存给写线程做副本：先用回收的，没有时再分配，按页对齐以便直接I/O
+ * 调用者持有页管理器的锁
+ * @param pager
+ * @return
+ */
+static void* pager_buffer_alloc(Pager* pager) {
+    void* buffer = pager->spare_buffers;
+    if (buffer != NULL) {
+        pager->spare_buffers = *(void**)buffer;
+        return buffer;
+    }
+    if (posix_memalign(&buffer, PAGE_SIZE, PAGE_SIZE) != 0) {
+        // 内存耗尽时和malloc一样无法继续
+        abort();
+    }
+    return buffer;
+}
+
+/**
+ * 页的内存是否在mmap预留的地址空间里
+ * @param pager
+ * @param buffer
+ * @return
+ */
+static bool pager_in_map(Pager* pager, void* buffer) {
+    return pager->map != NULL && (char*)buffer >= pager->map && (char*)buffer < pager->map + PAGER_MMAP_RESERVE;
+}
+
+/**
+ * 把映射中的一页换成内容相同的私有页：之后checkpoint写文件不会改变它，旧版本可以继续指向它。
+ * linux上用mremap把拷贝整页换过去，不写原来的页，和正在读这一页的线程不冲突
+ * @param pager
+ * @param page
+ */
+static void pager_map_detach(Pager* pager, void* page) {
+    (void)pager;
+#ifdef __linux__
+    void* copy = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy != MAP_FAILED) {
+        memcpy(copy, page, PAGE_SIZE);
+        if (mremap(copy, PAGE_SIZE, PAGE_SIZE, MREMAP_MAYMOVE | MREMAP_FIXED, page) != MAP_FAILED) {
+            return;
+        }
+        munmap(copy, PAGE_SIZE);
+    }
+    // mremap不可用时退回下面的做法
+#endif
+    // 写一下让内核复制出私有页，写的是原来的值
+    volatile char* byte = page;
+    *byte = *byte;
+}
+
+/**
+ * 回收没有人再用的页内存。映射中的页是pager_map_detach换上的私有页，
+ * 重新映射文件的这一页，之后再访问看到的是文件的内容。调用者持有页管理器的锁
+ * @param pager
+ * @param buffer
+ */
+static void pager_buffer_release(Pager* pager, void* buffer) {
+    if (pager_in_map(pager, buffer)) {
+        void* map = mmap(buffer, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, pager->file_descriptor,
+                         (char*)buffer - pager->map);
+        if (map == MAP_FAILED) {
+            // 这一页留着旧的私有内容，再读它会读错，不能继续
+            pager_fail(pager, EXECUTE_IO_ERROR);
+        }
+        return;
+    }
+    *(void**)buffer = pager->spare_buffers;
+    pager->spare_buffers = buffer;
+}
+
+/**
+ * 查找页的版本链，调用者持有页管理器的锁
+ * @param pager
+ * @param page_num
+ * @return 没有旧版本时返回NULL
+ */
+static PageVersions* pager_versions(Pager* pager, uint32_t page_num) {
+    if (pager->retired_head == NULL) {
+        // 没有任何旧版本，不用查
+        return NULL;
+    }
+    PageVersions* versions = pager->versions[pager_bucket(pager, page_num)];
+    while (versions != NULL && versions->page_num != page_num) {
+        versions = versions->hash_next;
+    }
+    return versions;
+}
+
+/**
+ * 页的内容被第end版取代，把旧内容挂到版本链上留给还在读旧版本的快照
+ * @param pager
+ * @param page_num
+ * @param data 旧内容
+ * @param end
+ */
+static void pager_retire_version(Pager* pager, uint32_t page_num, void* data, uint64_t end) {
+    PageVersions* versions = pager_versions(pager, page_num);
+    if (versions == NULL) {
+        // 第一个旧版本，之前的内容对所有快照都可见
+        versions = malloc(sizeof(PageVersions));
+        versions->page_num = page_num;
+        versions->begin = 0;
+        versions->newest = NULL;
+        uint32_t bucket = pager_bucket(pager, page_num);
+        versions->hash_next = pager->versions[bucket];
+        pager->versions[bucket] = versions;
+    }
+    PageVersion* version = malloc(sizeof(PageVersion));
+    version->data = data;
+    version->begin = versions->begin;
+    version->end = end;
+    version->page_num = page_num;
+    version->older = versions->newest;
+    version->next_retired = NULL;
+    versions->newest = version;
+    versions->begin = end;
+    if (pager->retired_tail != NULL) {
+        pager->retired_tail->next_retired = version;
+    } else {
+        pager->retired_head = version;
+    }
+    pager->retired_tail = version;
+    pager->stats.versions_kept++;
+}
+
+/**
+ * 回收没有快照能读到的旧版本：最旧的快照都已经看得到取代它的内容了。
+ * 按end从小到大回收，被回收的总是它那一页最旧的版本。调用者持有页管理器的锁
+ * @param pager
+ */
+static void pager_collect_versions(Pager* pager) {
+    uint64_t horizon = pager->oldest_snapshot != NULL ? pager->oldest_snapshot->version : UINT64_MAX;
+    while (pager->retired_head != NULL && pager->retired_head->end <= horizon) {
+        PageVersion* version = pager->retired_head;
+        PageVersions** link = &(pager->versions[pager_bucket(pager, version->page_num)]);
+        while ((*link)->page_num != version->page_num) {
+            link = &((*link)->hash_next);
+        }
+        PageVersions* versions = *link;
+        PageVersion** older = &(versions->newest);
+        while (*older != version) {
+            older = &((*older)->older);
+        }
+        *older = NULL;
+        if (versions->newest == NULL) {
+            // 这一页没有旧版本了
+            *link = versions->hash_next;
+            free(versions);
+        }
+        pager->retired_head = version->next_retired;
+        if (pager->retired_head == NULL) {
+            pager->retired_tail = NULL;
+        }
+        pager_buffer_release(pager, version->data);
+        free(version);
+    }
+}
+
+/**
+ * 开始一个快照：之后读到的都是到现在为止已经提交的内容，之后的提交看不到
+ * @param pager
+ * @param snapshot
+ */
+static void pager_snapshot_begin(Pager* pager, Snapshot* snapshot) {
+    pthread_mutex_lock(&(pager->mutex));
+    // 版本号只增不减，新快照总是最新的，链表按版本有序
+    snapshot->version = pager->committed_version;
+    snapshot->root_page_num = pager->committed_root;
+    snapshot->prev = pager->newest_snapshot;
+    snapshot->next = NULL;
+    if (pager->newest_snapshot != NULL) {
+        pager->newest_snapshot->next = snapshot;
+    } else {
+        pager->oldest_snapshot = snapshot;
+    }
+    pager->newest_snapshot = snapshot;
+    pthread_mutex_unlock(&(pager->mutex));
+}
+
+/**
+ * 结束快照，只有它还需要的旧版本被回收
+ * @param pager
+ * @param snapshot
+ */
+static void pager_snapshot_end(Pager* pager, Snapshot* snapshot) {
+    pthread_mutex_lock(&(pager->mutex));
+    if (snapshot->prev != NULL) {
+        snapshot->prev->next = snapshot->next;
+    } else {
+        pager->oldest_snapshot = snapshot->next;
+    }
+    if (snapshot->next != NULL) {
+        snapshot->next->prev = snapshot->prev;
+    } else {
+        pager->newest_snapshot = snapshot->prev;
+    }
+    if (snapshot->prev == NULL) {
+        pager_collect_versions(pager);
+    }
+    pthread_mutex_unlock(&(pager->mutex));
+}
+
+/**
+ * 提交写线程的修改：所有副本一起成为页的当前内容，版本号加一。
+ * 有快照在读时被取代的内容挂到版本链上，否则直接回收。
+ * 调用者持有页管理器的锁，b树处于一致状态
+ * @param pager
+ */
+static void pager_publish(Pager* pager) {
+    if (pager->num_pending == 0) {
+        return;
+    }
+    uint64_t version = pager->committed_version + 1;
+    for (uint32_t i = 0; i < pager->num_pending; i++) {
+        Frame* frame = &(pager->frames[pager->pending[i]]);
+        if (pager->oldest_snapshot != NULL) {
+            // 正在进行的快照版本都比新版本旧，可能还会读旧内容
+            if (frame->mapped) {
+                pager_map_detach(pager, frame->data);
+            }
+            pager_retire_version(pager, frame->page_num, frame->data, version);
+        } else if (!frame->mapped) {
+            pager_buffer_release(pager, frame->data);
+        }
+        if (frame->mapped) {
+            // 映射时帧自己的内存没有用
+            pager_buffer_release(pager, frame->buffer);
+        }
+        frame->data = frame->working;
+        frame->buffer = frame->working;
+        frame->working = NULL;
+        frame->mapped = false;
+    }
+    pager->num_pending = 0;
+    pager->committed_version = version;
+    pager->committed_root = pager->root_page_num;
+}
+
+/**
+ * 丢掉写线程还没提交的副本，回到最近一次提交的根。调用者持有页管理器的锁
+ * @param pager
+ */
+static void pager_discard(Pager* pager) {
+    for (uint32_t i = 0; i < pager->num_pending; i++) {
+        Frame* frame = &(pager->frames[pager->pending[i]]);
+        pager_buffer_release(pager, frame->working);
+        frame->working = NULL;
+    }
+    pager->num_pending = 0;
+    pager->root_page_num = pager->committed_root;
+}
+
+static void pager_cow_sync(Pager* pager);
+static void pager_checkpoint(Pager* pager);
+static void pager_shrink_frames(Pager* pager);
+
+/**
+ * 提交写线程的修改，修改b树的线程在每条语句结束时调用。
+ * 写时复制模式下攒够group_size条修改过b树的语句写一次meta页。
+ * 语句执行中扩大过缓冲池时，提交之后把多出来的帧还回去
+ * @param pager
+ */
+static void pager_commit(Pager* pager) {
+    pthread_mutex_lock(&(pager->mutex));
+    bool changed = pager->num_pending > 0 || pager->partial_commit;
+    pager->partial_commit = false;
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        // 出错的语句没有效果：丢掉副本，读还是看到上一次提交的内容
+        pager_discard(pager);
+        pthread_mutex_unlock(&(pager->mutex));
+        return;
+    }
+    pager_publish(pager);
+    pthread_mutex_unlock(&(pager->mutex));
+    if (changed && pager->copy_on_write && ++pager->unsynced_commits >= pager->group_size) {
+        pager_cow_sync(pager);
+    }
+    if (pager->num_frames > pager->arena_frames) {
+        if (pager->wal != NULL) {
+            // 多出来的帧上的脏页只能由checkpoint写回
+            pager_checkpoint(pager);
+        }
+        pager_shrink_frames(pager);
+    }
+}
+
+/**
+ * 从文件同步读一页。读失败时记下错误，页的内容换成空叶子，
+ * 正在进行的语句读到的是一棵不完整但结构合法的树，结束时返回错误
+ * @param pager
+ * @param page_num
+ * @param data
+ */
+static void pager_read_page(Pager* pager, uint32_t page_num, void* data) {
+    if (pread(pager->file_descriptor, data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != PAGE_SIZE) {
+        initialize_leaf_node(data);
+        pager_fail(pager, EXECUTE_IO_ERROR);
+    }
+    pager->stats.pages_read++;
+}
+
+/**
+ * 处理一个完成的预读请求：解除I/O的pin，读失败时改用同步读
+ * @param pager
+ * @param user_data 帧编号
+ * @param result
+ */
+static void pager_complete_io(Pager* pager, uint64_t user_data, int32_t result) {
+    Frame* frame = &(pager->frames[user_data]);
+    if (result != (int32_t)PAGE_SIZE) {
+        pager_read_page(pager, frame->page_num, frame->data);
+    } else {
+        pager->stats.pages_read++;
+    }
+    frame->io_pending = false;
+    frame->pin_count--;
+}
+
+/**
+ * io_uring不能再用了：还在队列里的预读都改成同步读，之后不再预读。
+ * 内核晚到的完成写进帧的也是同样的文件内容
+ * @param pager
+ */
+static void pager_ring_failed(Pager* pager) {
+    pager_fail(pager, EXECUTE_IO_ERROR);
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        if (pager->frames[i].io_pending) {
+            pager_complete_io(pager, i, -1);
+        }
+    }
+    ring_close(pager->ring);
+    pager->ring = NULL;
+}
+
+/**
+ * 处理已经完成的异步请求，wait为true时至少等到一个请求完成
+ * @param pager
+ * @param wait
+ */
+static void pager_reap_io(Pager* pager, bool wait) {
+    uint64_t user_data;
+    int32_t result;
+    bool reaped = false;
+    while (ring_complete(pager->ring, &user_data, &result)) {
+        pager_complete_io(pager, user_data, result);
+        reaped = true;
+    }
+    if (wait && !reaped && ring_busy(pager->ring) > 0) {
+        if (!ring_enter(pager->ring, true)) {
+            pager_ring_failed(pager);
+            return;
+        }
+        while (ring_complete(pager->ring, &user_data, &result)) {
+            pager_complete_io(pager, user_data, result);
+        }
+    }
+}
+
+/**
+ * 等待所有异步请求完成
+ * @param pager
+ */
+static void pager_drain_io(Pager* pager) {
+    if (pager->ring == NULL) {
+        return;
+    }
+    if (!ring_enter(pager->ring, false)) {
+        pager_ring_failed(pager);
+        return;
+    }
+    while (pager->ring != NULL && ring_busy(pager->ring) > 0) {
+        pager_reap_io(pager, true);
+    }
+}
+
+/**
+ * 帧已经写回文件：更新文件长度、脏页标记和统计
+ * @param pager
+ * @param frame_num
+ */
+static void pager_frame_written(Pager* pager, int32_t frame_num) {
+    Frame* frame = &(pager->frames[frame_num]);
+    if (((uint64_t)frame->page_num + 1) * PAGE_SIZE > pager->file_length) {
+        // 文件变长了
+        pager->file_length = ((uint64_t)frame->page_num + 1) * PAGE_SIZE;
+    }
+    if (frame->dirty) {
+        frame->dirty = false;
+        pager->num_dirty--;
+    }
+    pager->stats.pages_written++;
+}
+
+/**
+ * 把一帧写入文件
+ * @param pager 页管理器
+ * @param frame_num 帧编号
+ * @return 写入失败时返回false，帧还是脏页
+ */
+static bool pager_write_frame(Pager* pager, int32_t frame_num) {
+    Frame* frame = &(pager->frames[frame_num]);
+    // 按位置写，不依赖也不修改文件的读写位置；可能只写了一部分，接着写剩下的
+    off_t offset = (off_t)frame->page_num * PAGE_SIZE;
+    uint32_t written = 0;
+    while (written < PAGE_SIZE) {
+        ssize_t result = pwrite(pager->file_descriptor, (char*)frame->data + written, PAGE_SIZE - written,
+                                offset + written);
+        if (result == -1) {
+            return false;
+        }
+        written += result;
+    }
+    pager_frame_written(pager, frame_num);
+    return true;
+}
+
+/**
+ * 把页编号连续的几帧用一次pwritev写入文件。
+ * checkpoint写文件时不持有页管理器的锁，而io_uring的队列和预读共用、要在锁里操作，所以这里只用同步I/O
+ * @param pager
+ * @param pages 页编号连续的脏页
+ * @param count 页数
+ * @param iov 调用者提供的count个iovec，写了一部分时会被修改
+ * @return 写入失败时返回false
+ */
+static bool pager_write_run(Pager* pager, DirtyPage* pages, uint32_t count, struct iovec* iov) {
+    for (uint32_t i = 0; i < count; i++) {
+        iov[i].iov_base = pages[i].data;
+        iov[i].iov_len = PAGE_SIZE;
+    }
+    off_t offset = (off_t)pages[0].page_num * PAGE_SIZE;
+    struct iovec* remaining = iov;
+    uint32_t remaining_count = count;
+    while (remaining_count > 0) {
+        ssize_t result = pwritev(pager->file_descriptor, remaining, (int)remaining_count, offset);
+        if (result == -1) {
+            return false;
+        }
+        // 只写了一部分时跳过已经写完的页，写了一半的页从剩下的部分接着写
+        offset += result;
+        while (remaining_count > 0 && (size_t)result >= remaining->iov_len) {
+            result -= remaining->iov_len;
+            remaining++;
+            remaining_count--;
+        }
+        if (remaining_count > 0) {
+            remaining->iov_base = (char*)remaining->iov_base + result;
+            remaining->iov_len -= result;
+        }
+    }
+    return true;
+}
+
+/**
+ * qsort比较函数：按页编号升序
+ */
+static int compare_dirty_page(const void* a, const void* b) {
+    uint32_t page_a = ((const DirtyPage*)a)->page_num;
+    uint32_t page_b = ((const DirtyPage*)b)->page_num;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+/**
+ * 收集并pin住缓冲池中所有脏页，按页编号排序，没有修改过的页直接跳过。
+ * pin住之后checkpoint可以不持锁写它们，调用者持有页管理器的锁
+ * @param pager
+ * @param num_pages 脏页数
+ * @return 脏页数组，调用者释放
+ */
+static DirtyPage* pager_pin_dirty(Pager* pager, uint32_t* num_pages) {
+    DirtyPage* pages = malloc(sizeof(DirtyPage) * pager->num_frames);
+    *num_pages = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        Frame* frame = &(pager->frames[i]);
+        if (!frame->in_use) {
+            continue;
+        }
+        if (frame->dirty) {
+            frame->pin_count++;
+            pages[*num_pages].page_num = frame->page_num;
+            pages[*num_pages].frame_num = i;
+            pages[*num_pages].data = frame->data;
+            (*num_pages)++;
+        } else {
+            pager->stats.pages_skipped++;
+        }
+    }
+    qsort(pages, *num_pages, sizeof(DirtyPage), compare_dirty_page);
+    return pages;
+}
+
+/**
+ * 把pin住的脏页写回文件，页编号连续的脏页合并成一次pwritev。
+ * 不需要持有页管理器的锁：写的是已经提交的内容，只有调用者(修改b树的线程)会提交新内容替换它们
+ * @param pager
+ * @param pages pager_pin_dirty返回的脏页
+ * @param num_pages
+ * @return 有一次写入失败就返回false，剩下的页不再写
+ */
+static bool pager_write_pages(Pager* pager, DirtyPage* pages, uint32_t num_pages) {
+    struct iovec* iov = malloc(sizeof(struct iovec) * (num_pages > 0 ? num_pages : 1));
+    uint32_t start = 0;
+    bool written = true;
+    while (written && start < num_pages) {
+        uint32_t end = start + 1;
+        while (end < num_pages && end - start < PAGER_MAX_WRITE_RUN &&
+               pages[end].page_num == pages[end - 1].page_num + 1) {
+            end++;
+        }
+        written = pager_write_run(pager, pages + start, end - start, iov + start);
+        start = end;
+    }
+    free(iov);
+    return written;
+}
+
+/**
+ * 在数组末尾加一个页编号
+ * @param list
+ * @param page_num
+ */
+static void page_list_push(PageList* list, uint32_t page_num) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        list->pages = realloc(list->pages, sizeof(uint32_t) * list->capacity);
+    }
+    list->pages[list->count++] = page_num;
+}
+
+/**
+ * 页能不能原地修改。只有写时复制模式有限制：最近一次写的meta引用的页不能改，
+ * 上次写meta之后新分配的页和从空闲页中取出来的页可以改
+ * @param pager
+ * @param page_num
+ * @return
+ */
+static bool pager_page_writable(Pager* pager, uint32_t page_num) {
+    if (!pager->copy_on_write || page_num >= pager->fresh_page_num) {
+        return true;
+    }
+    return page_num / 8 < pager->reused_pages_size && (pager->reused_pages[page_num / 8] & (1 << (page_num % 8)));
+}
+
+/**
+ * 释放不再使用的页，之后get_unused_page_num可以重用它。
+ * 写时复制模式下最近一次写的meta还引用着的页要等下次写meta之后才能重用
+ * @param pager
+ * @param page_num
+ */
+static void pager_free_page(Pager* pager, uint32_t page_num) {
+    if (pager_page_writable(pager, page_num)) {
+        page_list_push(&(pager->free_pages), page_num);
+    } else {
+        page_list_push(&(pager->pending_free), page_num);
+    }
+    pager->free_list_dirty = true;
+}
+
+static void pager_save_free_list(Pager* pager);
+
+/**
+ * checkpoint：先提交写线程还没提交的修改，再把脏页写回数据库文件，然后清空wal。
+ * 先把所有脏页的镜像和一条CHECKPOINT记录写进wal并fdatasync，再原地写数据库文件，
+ * 这样原地写到一半崩溃时，恢复可以用wal中的镜像把数据库文件补完整。
+ * 只能在b树处于一致状态(语句之间)时由修改b树的线程调用。
+ * 只有收集脏页和写完之后更新脏标记时持有页管理器的锁，读的线程不用等写文件和fsync。
+ * 已经出错时什么都不做；写失败时记下错误，脏页保持脏，wal不清空，下次打开时恢复
+ * @param pager
+ */
+static void pager_checkpoint(Pager* pager) {
+    Wal* wal = pager->wal;
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        return;
+    }
+    // 空闲页链表的页和其他脏页一起写出去
+    pager_save_free_list(pager);
+    pthread_mutex_lock(&(pager->mutex));
+    pager_publish(pager);
+    if (wal != NULL && pager->num_dirty == 0 && wal->file_length == 0 && wal->buffer_length == 0) {
+        // 没有需要持久化的东西
+        pthread_mutex_unlock(&(pager->mutex));
+        return;
+    }
+    uint32_t num_pages;
+    DirtyPage* pages = pager_pin_dirty(pager, &num_pages);
+    // 写时复制模式的meta页由pager_cow_sync在页落盘之后单独写，其他模式和脏页一起写
+    char* meta = NULL;
+    if (!pager->copy_on_write && num_pages > 0) {
+        pager->txn_id++;
+        meta = pager_encode_meta(pager);
+    }
+    pager->flushing = true;
+    pthread_mutex_unlock(&(pager->mutex));
+
+    if (wal != NULL) {
+        char* record = malloc(sizeof(uint32_t) + PAGE_SIZE);
+        for (uint32_t i = 0; i < num_pages; i++) {
+            memcpy(record, &(pages[i].page_num), sizeof(uint32_t));
+            memcpy(record + sizeof(uint32_t), pages[i].data, PAGE_SIZE);
+            wal_append(wal, WAL_RECORD_PAGE, record, sizeof(uint32_t) + PAGE_SIZE);
+        }
+        if (meta != NULL) {
+            // meta页的镜像也写进wal，恢复时和脏页一起补完整
+            uint32_t meta_page_num = pager->txn_id % META_PAGES;
+            memcpy(record, &meta_page_num, sizeof(uint32_t));
+            memcpy(record + sizeof(uint32_t), meta, PAGE_SIZE);
+            wal_append(wal, WAL_RECORD_PAGE, record, sizeof(uint32_t) + PAGE_SIZE);
+        }
+        free(record);
+        wal_append(wal, WAL_RECORD_CHECKPOINT, NULL, 0);
+    }
+    // wal中的镜像落盘之后才能原地写数据库文件
+    bool written = (wal == NULL || wal_sync(wal, &(pager->stats))) && pager_write_pages(pager, pages, num_pages) &&
+                   (meta == NULL || pager_write_meta(pager, meta)) &&
+                   (wal == NULL || fsync(pager->file_descriptor) != -1);
+    if (!written) {
+        pager_fail(pager, EXECUTE_IO_ERROR);
+    }
+
+    pthread_mutex_lock(&(pager->mutex));
+    for (uint32_t i = 0; i < num_pages; i++) {
+        if (written) {
+            pager_frame_written(pager, pages[i].frame_num);
+        }
+        pager->frames[pages[i].frame_num].pin_count--;
+    }
+    if (wal != NULL && written) {
+        pager->stats.checkpoints++;
+    }
+    pager->flushing = false;
+    pthread_cond_broadcast(&(pager->flushed));
+    pthread_mutex_unlock(&(pager->mutex));
+    free(pages);
+
+    if (written && wal != NULL && !wal->keep_records && !wal_truncate(wal)) {
+        // 重放或者批量插入过程中wal里还有没应用完的记录，不能清空
+        pager_fail(pager, EXECUTE_IO_ERROR);
+    }
+}
+
+/**
+ * 写时复制模式的持久化：先把新页写进文件并fdatasync，再把新的根写进另一个meta页。
+ * 崩溃时要么还是旧的meta，旧的树一页都没有被改过；要么是新的meta，它引用的页都已经落盘。
+ * 之后再修改这些页都要先复制
+ * @param pager
+ */
+static void pager_cow_sync(Pager* pager) {
+    if (pager->unsynced_commits == 0 || pager_error(pager) != EXECUTE_SUCCESS) {
+        return;
+    }
+    pager_checkpoint(pager);
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        return;
+    }
+    if (fdatasync(pager->file_descriptor) == -1) {
+        // 新页不一定落盘了，不能写引用它们的meta
+        pager_fail(pager, EXECUTE_IO_ERROR);
+        return;
+    }
+    pager->txn_id++;
+    if (!pager_write_meta(pager, pager_encode_meta(pager)) || fdatasync(pager->file_descriptor) == -1) {
+        // 写了一半的meta页校验和对不上，打开时用另一个
+        pager_fail(pager, EXECUTE_IO_ERROR);
+        return;
+    }
+    pager->fresh_page_num = pager->num_pages;
+    pager->unsynced_commits = 0;
+    pager->stats.checkpoints++;
+    // 新的meta已经落盘，旧的树中释放的页没有被引用了，可以重用
+    for (uint32_t i = 0; i < pager->pending_free.count; i++) {
+        page_list_push(&(pager->free_pages), pager->pending_free.pages[i]);
+    }
+    pager->pending_free.count = 0;
+    memset(pager->reused_pages, 0, pager->reused_pages_size);
+}
+
+/**
+ * 把缓冲池扩大一倍。新的帧使用单独分配的内存，页表的桶数不变。
+ * 有副本的帧在语句提交之前不能淘汰，也不能被checkpoint写回，一条语句修改的页多时先扩大缓冲池，
+ * 最多扩大到配置帧数的PAGER_MAX_GROWTH倍，语句提交之后由pager_shrink_frames还回去。调用者持有页管理器的锁
+ * @param pager
+ */
+static void pager_grow_frames(Pager* pager) {
+    uint32_t old_frames = pager->num_frames;
+    uint32_t num_frames = old_frames * 2;
+    pager->frames = realloc(pager->frames, sizeof(Frame) * num_frames);
+    pager->pending = realloc(pager->pending, sizeof(int32_t) * num_frames);
+    for (int32_t i = num_frames - 1; i >= (int32_t)old_frames; i--) {
+        pager->frames[i].data = NULL;
+        pager->frames[i].buffer = pager_buffer_alloc(pager);
+        pager->frames[i].working = NULL;
+        pager->frames[i].mapped = false;
+        pager->frames[i].io_pending = false;
+        pager->frames[i].in_use = false;
+        pager->frames[i].pin_count = 0;
+        pager->frames[i].dirty = false;
+        pager->frames[i].referenced = false;
+        pager->frames[i].hash_next = pager->free_frames;
+        pager->free_frames = i;
+    }
+    pager->num_frames = num_frames;
+}
+
+/**
+ * 缓冲池能不能再扩大一倍
+ * @param pager
+ * @return
+ */
+static bool pager_can_grow(Pager* pager) {
+    return (uint64_t)pager->num_frames * 2 <= (uint64_t)pager->arena_frames * PAGER_MAX_GROWTH;
+}
+
+/**
+ * 有副本的帧超过四分之一、或者使用wal时干净帧少于needed个时腾出帧：
+ * 先在上限以内扩大缓冲池，语句的修改在pager_commit时一起对读可见；
+ * 到了上限就把语句到这里为止的修改发布出去，副本成为普通的脏页，可以写回之后淘汰。
+ * 这时读会看到语句的一部分修改，wal和写时复制的meta页仍然只记录整条语句，崩溃之后不会只剩一部分。
+ * 调用者持有页管理器的锁，b树处于一致状态
+ * @param pager
+ * @param needed
+ */
+static void pager_limit_pending(Pager* pager, uint32_t needed) {
+    while (pager->num_pending > 0 && (pager->num_pending > pager->num_frames / 4 ||
+           (pager->wal != NULL && pager->num_frames - pager->num_dirty < needed))) {
+        if (!pager_can_grow(pager)) {
+            pager_publish(pager);
+            pager->partial_commit = true;
+            break;
+        }
+        pager_grow_frames(pager);
+    }
+}
+
+/**
+ * 在修改b树之前确保缓冲池中至少有needed个干净的帧。
+ * 使用wal时脏页只能由checkpoint写回，所以干净帧不够时做一次checkpoint。
+ * checkpoint会提交写线程的副本，语句已经修改过页之后先由pager_limit_pending扩大缓冲池或者发布修改。
+ * 在两行插入之间调用，b树处于一致状态
+ * @param pager
+ * @param needed
+ */
+static void pager_reserve_frames(Pager* pager, uint32_t needed) {
+    pthread_mutex_lock(&(pager->mutex));
+    pager_limit_pending(pager, needed);
+    bool checkpoint = pager->wal != NULL && pager->num_pending == 0 && pager->num_frames - pager->num_dirty < needed;
+    pthread_mutex_unlock(&(pager->mutex));
+    if (checkpoint) {
+        pager_checkpoint(pager);
+    }
+}
+
+/**
+ * 把缓冲池缩回配置的帧数，扩大时新加的帧和回收的页内存还给系统，在语句提交之后调用。
+ * 多出来的帧上有被pin住的页、正在预读的页或者使用wal时还没写回的脏页时这次不缩，下次提交再试；
+ * 不使用wal时脏页先写回
+ * @param pager
+ */
+static void pager_shrink_frames(Pager* pager) {
+    pthread_mutex_lock(&(pager->mutex));
+    uint32_t num_frames = pager->arena_frames;
+    bool busy = pager->flushing || pager->num_pending > 0;
+    for (uint32_t i = num_frames; i < pager->num_frames && !busy; i++) {
+        Frame* frame = &(pager->frames[i]);
+        busy = frame->pin_count > 0 || frame->io_pending || (frame->dirty && pager->wal != NULL);
+    }
+    if (busy) {
+        pthread_mutex_unlock(&(pager->mutex));
+        return;
+    }
+    for (uint32_t i = num_frames; i < pager->num_frames; i++) {
+        Frame* frame = &(pager->frames[i]);
+        if (frame->in_use) {
+            if (frame->dirty && (pager_error(pager) != EXECUTE_SUCCESS || !pager_write_frame(pager, i))) {
+                // 和淘汰一样，出错之后脏页直接丢掉
+                pager_fail(pager, EXECUTE_IO_ERROR);
+                frame->dirty = false;
+                pager->num_dirty--;
+            }
+            pager_hash_remove(pager, i);
+        }
+        pager_buffer_release(pager, frame->buffer);
+    }
+    // 空闲帧链表中去掉多出来的帧
+    int32_t* link = &(pager->free_frames);
+    while (*link != -1) {
+        if (*link >= (int32_t)num_frames) {
+            *link = pager->frames[*link].hash_next;
+        } else {
+            link = &(pager->frames[*link].hash_next);
+        }
+    }
+    // 回收的页内存只留arena里的，其他的还给系统
+    void** spare = &(pager->spare_buffers);
+    while (*spare != NULL) {
+        char* buffer = *spare;
+        if (buffer < pager->arena || buffer >= pager->arena + (size_t)pager->arena_frames * PAGE_SIZE) {
+            *spare = *(void**)buffer;
+            free(buffer);
+        } else {
+            spare = (void**)buffer;
+        }
+    }
+    pager->frames = realloc(pager->frames, sizeof(Frame) * num_frames);
+    pager->pending = realloc(pager->pending, sizeof(int32_t) * num_frames);
+    pager->num_frames = num_frames;
+    if (pager->clock_hand >= num_frames) {
+        pager->clock_hand = 0;
+    }
+    pthread_mutex_unlock(&(pager->mutex));
+}
+
+/**
+ * 找一个可以使用的帧：先从空闲链表中取，没有空闲帧时用CLOCK算法淘汰：
+ * 跳过被pin住的帧，引用位为1的帧清零后给第二次机会，脏页淘汰前先写回文件。
+ * 使用wal时只淘汰干净的页，因为在checkpoint之外原地写数据库文件会破坏崩溃恢复的前提，
+ * 脏页要等修改b树的线程在语句之间做checkpoint(见pager_reserve_frames)
+ * @param pager
+ * @return 空闲帧编号，所有帧都被pin住(或者使用wal时剩下的都是脏页)时返回-1
+ */
+static int32_t pager_evict(Pager* pager) {
+    if (pager->ring != NULL) {
+        // 已经完成的预读会解除pin
+        pager_reap_io(pager, false);
+    }
+    if (pager->free_frames != -1) {
+        // 还有空闲帧，不需要淘汰
+        int32_t frame_num = pager->free_frames;
+        pager->free_frames = pager->frames[frame_num].hash_next;
+        pager->frames[frame_num].hash_next = -1;
+        return frame_num;
+    }
+    // 出错之后不再写数据库文件，脏页可以直接丢掉
+    bool skip_dirty = pager->wal != NULL && pager_error(pager) == EXECUTE_SUCCESS;
+    // 转两圈还找不到说明所有帧都被pin住了(或者都是脏页)
+    for (uint32_t i = 0; i < 2 * pager->num_frames; i++) {
+        int32_t frame_num = pager->clock_hand;
+        Frame* frame = &(pager->frames[frame_num]);
+        pager->clock_hand = (pager->clock_hand + 1) % pager->num_frames;
+
+        if (frame->pin_count > 0 || frame->working != NULL || (skip_dirty && frame->dirty)) {
+            // 有未提交副本的帧在提交之前也不能淘汰
+            continue;
+        }
+        if (frame->referenced) {
+            frame->referenced = false;
+            continue;
+        }
+
+        // 找到了淘汰对象
+        if (frame->dirty && (pager_error(pager) != EXECUTE_SUCCESS || !pager_write_frame(pager, frame_num))) {
+            // 出错之后不再写数据库文件，脏页直接丢掉
+            pager_fail(pager, EXECUTE_IO_ERROR);
+            frame->dirty = false;
+            pager->num_dirty--;
+        }
+        pager->stats.evictions++;
+        pager_hash_remove(pager, frame_num);
+        frame->in_use = false;
+        return frame_num;
+    }
+    return -1;
+}
+
+/**
+ * 把页放进帧并加入页表，页被pin住一次
+ * @param pager
+ * @param frame_num
+ * @param page_num
+ */
+static void pager_install_frame(Pager* pager, int32_t frame_num, uint32_t page_num) {
+    Frame* frame = &(pager->frames[frame_num]);
+    frame->page_num = page_num;
+    frame->in_use = true;
+    frame->pin_count = 1;
+    frame->dirty = false;
+    frame->referenced = true;
+    uint32_t bucket = pager_bucket(pager, page_num);
+    frame->hash_next = pager->buckets[bucket];
+    pager->buckets[bucket] = frame_num;
+
+    if (page_num >= pager->num_pages) {
+        // 如果page_num大于当前节点的总pages数，更新pager->num_pages
+        pager->num_pages = page_num + 1;
+    }
+}
+
+/**
+ * 让帧使用自己的内存
+ * @param frame
+ */
+static void frame_use_buffer(Frame* frame) {
+    frame->data = frame->buffer;
+    frame->mapped = false;
+}
+
+/**
+ * 异步预读一组页，调用者接下来很可能按顺序访问它们。
+ * 有io_uring时每页占用一帧并一次性提交所有读请求，帧在读完之前被I/O pin住；
+ * mmap模式下提示内核预读映射；两者都没有时不做任何事。
+ * 预读最多占用四分之一的帧，已经在缓冲池中的页直接跳过
+ * @param pager
+ * @param page_nums
+ * @param count
+ */
+static void pager_prefetch(Pager* pager, uint32_t* page_nums, uint32_t count) {
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        return;
+    }
+    pthread_mutex_lock(&(pager->mutex));
+    uint32_t num_pages_on_disk = pager->file_length / PAGE_SIZE;
+    Ring* ring = pager->ring;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t page_num = page_nums[i];
+        if (page_num >= num_pages_on_disk || pager_lookup(pager, page_num) != -1) {
+            continue;
+        }
+        if (pager->map != NULL) {
+            if ((uint64_t)(page_num + 1) * PAGE_SIZE <= pager->map_length) {
+                madvise(pager->map + (uint64_t)page_num * PAGE_SIZE, PAGE_SIZE, MADV_WILLNEED);
+                pager->stats.pages_prefetched++;
+            }
+            continue;
+        }
+        if (ring == NULL || ring_space(ring) == 0 || ring_busy(ring) >= pager->num_frames / 4) {
+            break;
+        }
+        int32_t frame_num = pager_evict(pager);
+        if (frame_num == -1) {
+            break;
+        }
+        Frame* frame = &(pager->frames[frame_num]);
+        frame_use_buffer(frame);
+        pager_install_frame(pager, frame_num, page_num);
+        frame->io_pending = true;
+        ring_prepare(ring, IORING_OP_READ, pager->file_descriptor, frame->data, PAGE_SIZE,
+                     (uint64_t)page_num * PAGE_SIZE, frame_num);
+        pager->stats.pages_prefetched++;
+    }
+    if (ring != NULL && !ring_enter(ring, false)) {
+        pager_ring_failed(pager);
+    }
+    pthread_mutex_unlock(&(pager->mutex));
+}
+
+/**
+ * 把页pin在缓冲池中，调用者持有页管理器的锁
+ * @param pager
+ * @param page_num
+ * @return 页所在的帧编号
+ */
+static int32_t pager_pin(Pager* pager, uint32_t page_num) {
+    int32_t frame_num = pager_lookup(pager, page_num);
+    if (frame_num != -1) {
+        // 命中缓冲池
+        Frame* frame = &(pager->frames[frame_num]);
+        frame->pin_count++;
+        frame->referenced = true;
+        pager->stats.cache_hits++;
+        while (frame->io_pending) {
+            // 预读还没完成
+            pager_reap_io(pager, true);
+        }
+        return frame_num;
+    }
+
+    // 没有命中，找一个帧把页读进来
+    frame_num = pager_evict(pager);
+    if (frame_num == -1 && pager->ring != NULL && ring_busy(pager->ring) > 0) {
+        // 等预读完成后释放它们占用的帧
+        pager_drain_io(pager);
+        frame_num = pager_evict(pager);
+    }
+    while (frame_num == -1 && pager->flushing) {
+        // checkpoint pin住了所有脏页，等它写完
+        pthread_cond_wait(&(pager->flushed), &(pager->mutex));
+        frame_num = pager_evict(pager);
+    }
+    // 这里持有锁，b树可能改到一半，不能checkpoint
+    if (frame_num == -1 && !pager_can_grow(pager)) {
+        // 缓冲池已经到了上限，语句失败；出错之后脏页可以直接丢掉
+        pager_fail(pager, EXECUTE_TABLE_FULL);
+        frame_num = pager_evict(pager);
+    }
+    if (frame_num == -1) {
+        // 所有帧都被pin住了，或者使用wal时剩下的都是脏页，扩大缓冲池
+        pager_grow_frames(pager);
+        frame_num = pager_evict(pager);
+    }
+    Frame* frame = &(pager->frames[frame_num]);
+
+    uint32_t num_pages_on_disk = pager->file_length / PAGE_SIZE;
+    if (pager->map != NULL && page_num < num_pages_on_disk && ((uint64_t)page_num + 1) * PAGE_SIZE <= PAGER_MMAP_RESERVE &&
+        pager_versions(pager, page_num) == NULL &&
+        (((uint64_t)page_num + 1) * PAGE_SIZE <= pager->map_length || (pager_map_extend(pager) &&
+                                                                        ((uint64_t)page_num + 1) * PAGE_SIZE <= pager->map_length))) {
+        // mmap模式：直接使用映射中的页，不需要read和拷贝。
+        // 有旧版本的页在映射中可能是旧版本的私有页，不能用；映射扩展失败的页用pread读
+        frame->data = pager->map + (uint64_t)page_num * PAGE_SIZE;
+        frame->mapped = true;
+        pager->stats.pages_mapped++;
+    } else {
+        // 文件中还没有的新页在写回之前没有可以映射的内容，使用帧自己的内存
+        frame_use_buffer(frame);
+        if (page_num < num_pages_on_disk) {
+            pager_read_page(pager, page_num, frame->data);
+        } else {
+            // 文件中还没有这一页
+            memset(frame->data, 0, PAGE_SIZE);
+        }
+    }
+
+    pager_install_frame(pager, frame_num, page_num);
+    return frame_num;
+}
+
+/**
+ * 根据页编号获取所在页地址，页会被pin住，用完之后需要调用unpin_page。
+ * 给修改b树的线程使用，能看到自己还没提交的修改；读取用get_page_at
+ * @param pager 页表数据结构
+ * @param page_num 页编号
+ * @return  所在页地址
+ */
+static void* get_page(Pager* pager, uint32_t page_num) {
+    pthread_mutex_lock(&(pager->mutex));
+    // pager_pin可能扩大缓冲池，移动frames数组，先取帧编号
+    int32_t frame_num = pager_pin(pager, page_num);
+    Frame* frame = &(pager->frames[frame_num]);
+    void* page = frame->working != NULL ? frame->working : frame->data;
+    pthread_mutex_unlock(&(pager->mutex));
+    return page;
+}
+
+/**
+ * 获取要修改的页，页会被pin住并标记为脏页。
+ * 第一次修改时拷贝出一个副本，之后都在副本上改，其他线程继续读提交过的内容，直到pager_commit
+ * @param pager
+ * @param page_num
+ * @return 副本的地址
+ */
+static void* get_page_for_write(Pager* pager, uint32_t page_num) {
+    pthread_mutex_lock(&(pager->mutex));
+    // 写时复制模式下已经持久化的页要先用pager_copy_page复制
+    assert(pager_page_writable(pager, page_num));
+    int32_t frame_num = pager_pin(pager, page_num);
+    Frame* frame = &(pager->frames[frame_num]);
+    if (frame->working == NULL) {
+        frame->working = pager_buffer_alloc(pager);
+        memcpy(frame->working, frame->data, PAGE_SIZE);
+        pager->pending[pager->num_pending++] = frame_num;
+    }
+    if (!frame->dirty) {
+        frame->dirty = true;
+        pager->num_dirty++;
+    }
+    // 解锁之后frames数组可能被其他线程扩大而移动
+    void* working = frame->working;
+    pthread_mutex_unlock(&(pager->mutex));
+    return working;
+}
+
+/**
+ * 读取快照中的页，页会被pin住，用完之后需要调用unpin_page。
+ * 提交过的内容不会被原地修改，不用加锁就能读：页在快照之后被提交过时从版本链里找快照能看到的那个版本
+ * @param pager
+ * @param page_num
+ * @param snapshot
+ * @return 快照中页的内容
+ */
+static void* get_page_at(Pager* pager, uint32_t page_num, Snapshot* snapshot) {
+    pthread_mutex_lock(&(pager->mutex));
+    int32_t frame_num = pager_pin(pager, page_num);
+    void* page = pager->frames[frame_num].data;
+    PageVersions* versions = pager_versions(pager, page_num);
+    if (versions != NULL && versions->begin > snapshot->version) {
+        // 快照开始之后被修改过，旧版本在快照结束之前不会被回收
+        PageVersion* version = versions->newest;
+        while (version->begin > snapshot->version) {
+            version = version->older;
+        }
+        page = version->data;
+    }
+    pthread_mutex_unlock(&(pager->mutex));
+    return page;
+}
+
+/**
+ * 找到被pin住的页所在的帧，调用者持有页管理器的锁
+ * @param pager
+ * @param page_num
+ * @return
+ */
+static Frame* pager_pinned_frame(Pager* pager, uint32_t page_num) {
+    int32_t frame_num = pager_lookup(pager, page_num);
+    assert(frame_num != -1 && pager->frames[frame_num].pin_count > 0);
+    return &(pager->frames[frame_num]);
+}
+
+/**
+ * 使用完页之后解除pin，之后这一页可以被淘汰
+ * @param pager
+ * @param page_num
+ */
+static void unpin_page(Pager* pager, uint32_t page_num) {
+    pthread_mutex_lock(&(pager->mutex));
+    pager_pinned_frame(pager, page_num)->pin_count--;
+    pthread_mutex_unlock(&(pager->mutex));
+}
+
+static void result_sink_close(ResultSink* sink);
+
+/**
+ * 释放表内存的函数，调用时其他线程不能再使用这张表
+ * @param table
+ */
+ExecuteResult db_close(Table* table) {
+    Pager* pager = table->pager;
+//    uint32_t num_full_pages = table->num_rows / ROWS_PER_PAGE; // 满页数量
+
+    // 等预读完成，再持久化，只写修改过的页
+    pager_drain_io(pager);
+    if (pager->copy_on_write) {
+        pager_cow_sync(pager);
+    } else {
+        pager_checkpoint(pager);
+    }
+    ExecuteResult error = pager_error(pager);
+    if (pager->wal != NULL) {
+        if (error != EXECUTE_SUCCESS) {
+            // 出错之后数据库文件可能少了已经提交的修改，尽量把缓冲区中的记录写进wal，留给下次恢复
+            wal_sync(pager->wal, &(pager->stats));
+        }
+        // 否则所有修改都已经在数据库文件里了，wal可以删掉
+        wal_close(pager->wal, error == EXECUTE_SUCCESS);
+    }
+
+//    // 存储非完整页(将来用BTree就不需要这一步操作了)
+//    uint32_t num_remain_rows = table->num_rows % ROWS_PER_PAGE;
+//    if (num_remain_rows > 0) {
+//        uint32_t page_num = num_full_pages;
+//        if (pager->pages[page_num] != NULL) {
+//            // 如果最后一页不为空, 做持久化
+//            pager_flush(pager, page_num);
+//            free(pager->pages[page_num]);
+//            pager->pages[page_num] = NULL;
+//        }
+//    }
+
+    // 关闭文件
+    if (close(pager->file_descriptor) == -1 && error == EXECUTE_SUCCESS) {
+        error = EXECUTE_IO_ERROR;
+    }
+    result_sink_close(table->sink);
+    // 没有commit的事务直接丢弃
+    free(table->batch);
+    // 最后释放缓冲池，提交时换进帧里的内存和回收的内存不在arena里，单独释放
+    pager_collect_versions(pager);
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        pager_buffer_release(pager, pager->frames[i].buffer);
+    }
+    pager_buffer_release(pager, pager->meta_buffer);
+    while (pager->spare_buffers != NULL) {
+        char* buffer = pager->spare_buffers;
+        pager->spare_buffers = *(void**)buffer;
+        if (buffer < pager->arena || buffer >= pager->arena + (size_t)pager->arena_frames * PAGE_SIZE) {
+            free(buffer);
+        }
+    }
+    munmap(pager->arena, (size_t)pager->arena_frames * PAGE_SIZE);
+    if (pager->map != NULL) {
+        munmap(pager->map, PAGER_MMAP_RESERVE);
+    }
+    if (pager->ring != NULL) {
+        ring_close(pager->ring);
+    }
+    pthread_cond_destroy(&(pager->flushed));
+    pthread_mutex_destroy(&(pager->mutex));
+    pthread_mutex_destroy(&(table->write_lock));
+    free(pager->frames);
+    free(pager->buckets);
+    free(pager->versions);
+    free(pager->pending);
+    free(pager->free_pages.pages);
+    free(pager->pending_free.pages);
+    free(pager->free_list_pages.pages);
+    free(pager->reused_pages);
+    // 释放页管理器
+    free(pager);
+    // 释放表
+    free(table);
+    return error;
+}
+
+/**
+ * 把已经提交、还在等组提交凑满的插入马上持久化
+ * 调用者没有更多要写的东西时调用，不必等到下一组提交
+ * @param table
+ * @return
+ */
+ExecuteResult db_sync(Table* table) {
+    Pager* pager = table->pager;
+    pthread_mutex_lock(&(table->write_lock));
+    if (pager->wal != NULL && pager->wal->pending_commits > 0 && pager_error(pager) == EXECUTE_SUCCESS &&
+        !wal_sync(pager->wal, &(pager->stats))) {
+        pager_fail(pager, EXECUTE_IO_ERROR);
+    }
+    if (pager->copy_on_write) {
+        pager_cow_sync(pager);
+    }
+    pthread_mutex_unlock(&(table->write_lock));
+    return pager_error(pager);
+}
+/**
+ * 创建查询结果输出
+ * @param mode 输出格式
+ * @return
+ */
+static ResultSink* result_sink_open(OutputMode mode) {
+    ResultSink* sink = malloc(sizeof(ResultSink));
+    sink->mode = mode;
+    sink->buffer = malloc(RESULT_SINK_BUFFER_SIZE);
+    sink->length = 0;
+    return sink;
+}
+
+/**
+ * 解析输出格式的名字
+ * @param name table、csv、tsv或binary
+ * @param mode 解析出来的格式
+ * @return 是否识别
+ */
+bool parse_output_mode(const char* name, OutputMode* mode) {
+    if (strcmp(name, "table") == 0) {
+        *mode = OUTPUT_TABLE;
+    } else if (strcmp(name, "csv") == 0) {
+        *mode = OUTPUT_CSV;
+    } else if (strcmp(name, "tsv") == 0) {
+        *mode = OUTPUT_TSV;
+    } else if (strcmp(name, "binary") == 0) {
+        *mode = OUTPUT_BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 把缓冲区中的结果写到stdout
+ * @param sink
+ */
+static void result_sink_flush(ResultSink* sink) {
+    if (sink->length > 0) {
+        fwrite(sink->buffer, 1, sink->length, stdout);
+        sink->length = 0;
+    }
+}
+
+/**
+ * 释放查询结果输出，没写出去的结果先写出去
+ * @param sink
+ */
+static void result_sink_close(ResultSink* sink) {
+    result_sink_flush(sink);
+    free(sink->buffer);
+    free(sink);
+}
+
+/**
+ * 把无符号整数格式化成十进制，不经过printf
+ * @param value
+ * @param destination 至少10个字节
+ * @return 写入的字节数
+ */
+static uint32_t format_uint32(uint32_t value, char* destination) {
+    char digits[10];
+    uint32_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (uint32_t i = 0; i < count; i++) {
+        destination[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * 按输出格式写一个字符串字段，调用前要确认缓冲区剩余空间足够
+ * @param sink
+ * @param field
+ * @param length
+ */
+static void result_sink_put_string(ResultSink* sink, const char* field, uint8_t length) {
+    char* out = sink->buffer + sink->length;
+    switch (sink->mode) {
+        case OUTPUT_CSV:
+            if (memchr(field, ',', length) == NULL && memchr(field, '"', length) == NULL) {
+                memcpy(out, field, length);
+                out += length;
+                break;
+            }
+            // 含有逗号或引号的字段用引号括起来，引号写两遍
+            *out++ = '"';
+            for (uint32_t i = 0; i < length; i++) {
+                if (field[i] == '"') {
+                    *out++ = '"';
+                }
+                *out++ = field[i];
+            }
+            *out++ = '"';
+            break;
+        case OUTPUT_TSV:
+            for (uint32_t i = 0; i < length; i++) {
+                if (field[i] == '\t') {
+                    *out++ = '\\';
+                    *out++ = 't';
+                } else if (field[i] == '\\') {
+                    *out++ = '\\';
+                    *out++ = '\\';
+                } else {
+                    *out++ = field[i];
+                }
+            }
+            break;
+        case OUTPUT_BINARY:
+            *out++ = (char)length;
+            memcpy(out, field, length);
+            out += length;
+            break;
+        default:
+            memcpy(out, field, length);
+            out += length;
+            break;
+    }
+    sink->length = out - sink->buffer;
+}
+
+/**
+ * 按顺序输出行视图中选中的列
+ * @param sink
+ * @param view
+ * @param projection 要输出的列
+ * @param count 列数
+ */
+static void result_sink_write_row(ResultSink* sink, RowView* view, Column* projection, uint32_t count) {
+    if (sink->length + RESULT_SINK_MAX_ROW_SIZE > RESULT_SINK_BUFFER_SIZE) {
+        result_sink_flush(sink);
+    }
+    uint32_t row_start = sink->length;
+    if (sink->mode == OUTPUT_BINARY) {
+        sink->length += sizeof(uint32_t); // 行长度最后再填
+    } else if (sink->mode == OUTPUT_TABLE) {
+        sink->buffer[sink->length++] = '(';
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) {
+            // 列分隔符
+            if (sink->mode == OUTPUT_TABLE) {
+                sink->buffer[sink->length++] = ',';
+                sink->buffer[sink->length++] = ' ';
+            } else if (sink->mode == OUTPUT_CSV) {
+                sink->buffer[sink->length++] = ',';
+            } else if (sink->mode == OUTPUT_TSV) {
+                sink->buffer[sink->length++] = '\t';
+            }
+        }
+        switch (projection[i]) {
+            case COLUMN_ID:
+                if (sink->mode == OUTPUT_BINARY) {
+                    uint8_t* out = (uint8_t*)sink->buffer + sink->length;
+                    for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+                        out[b] = (uint8_t)(view->id >> (8 * b));
+                    }
+                    sink->length += sizeof(uint32_t);
+                } else {
+                    sink->length += format_uint32(view->id, sink->buffer + sink->length);
+                }
+                break;
+            case COLUMN_USERNAME:
+                result_sink_put_string(sink, view->username, view->username_length);
+                break;
+            case COLUMN_EMAIL:
+                result_sink_put_string(sink, view->email, view->email_length);
+                break;
+            default:
+                break;
+        }
+    }
+    if (sink->mode == OUTPUT_BINARY) {
+        uint32_t row_length = sink->length - row_start - sizeof(uint32_t);
+        uint8_t* out = (uint8_t*)sink->buffer + row_start;
+        for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            out[b] = (uint8_t)(row_length >> (8 * b));
+        }
+        return;
+    }
+    if (sink->mode == OUTPUT_TABLE) {
+        sink->buffer[sink->length++] = ')';
+    }
+    sink->buffer[sink->length++] = '\n';
+}
+
+/**
+ * 记录一个占位符
+ * @param statement
+ * @param target
+ * @param row
+ */
+static void statement_add_param(Statement* statement, ParamTarget target, uint32_t row) {
+    statement->params = realloc(statement->params, sizeof(ParamSlot) * (statement->num_params + 1));
+    statement->params[statement->num_params].target = target;
+    statement->params[statement->num_params].row = row;
+    statement->num_params++;
+}
+
+/**
+ * 释放语句解析时分配的内存
+ * @param statement
+ */
+static void statement_free(Statement* statement) {
+    free(statement->rows);
+    free(statement->params);
+    statement->rows = NULL;
+    statement->params = NULL;
+}
+
+/**
+ * 检查并填入insert一行的三个字段，字段是'?'时记录占位符
+ * @param statement
+ * @param row_index 第几行
+ * @param row
+ * @param id_string
+ * @param username
+ * @param email
+ * @return
+ */
+static PrepareResult prepare_row(Statement* statement, uint32_t row_index, Row* row,
+                                 char* id_string, char* username, char* email) {
+    if (strcmp(id_string, "?") == 0) {
+        statement_add_param(statement, PARAM_ID, row_index);
+        row->id = 0;
+    } else {
+        // id字符串转数字
+        int id = atoi(id_string);
+        // 检查id
+        if (id < 0) {
+            return PREPARE_NEGATIVE_ID;
+        }
+        row->id = id;
+    }
+    // 检查字段的长度
+    if (strlen(username) > COLUMN_USERNAME_SIZE){
+        return PREPARE_STRING_TOO_LONG;
+    }
+    if (strlen(email) > COLUMN_EMAIL_SIZE) {
+        return PREPARE_STRING_TOO_LONG;
+    }
+    if (strcmp(username, "?") == 0) {
+        statement_add_param(statement, PARAM_USERNAME, row_index);
+        username = "";
+    }
+    if (strcmp(email, "?") == 0) {
+        statement_add_param(statement, PARAM_EMAIL, row_index);
+        email = "";
+    }
+    strcpy(row->username, username);
+    strcpy(row->email, email);
+    return PREPARE_SUCCESS;
+}
+
+/**
+ * 把字符串两端的空格去掉
+ * @param string
+ * @return 去掉空格之后的起始位置
+ */
+static char* trim_spaces(char* string) {
+    string += strspn(string, " ");
+    size_t length = strlen(string);
+    while (length > 0 && string[length - 1] == ' ') {
+        string[--length] = '\0';
+    }
+    return string;
+}
+
+/**
+ * 解析多行insert：insert (1,a,b),(2,c,d),...
+ * 字段之间用逗号分隔，不能包含逗号和括号
+ * @param values 第一个'('开始的字符串
+ * @param statement 解析出来的行放在statement->rows，由调用者释放
+ * @return
+ */
+static PrepareResult prepare_insert_values(char* values, Statement* statement) {
+    uint32_t capacity = 16;
+    statement->rows = malloc(sizeof(Row) * capacity);
+    statement->num_rows = 0;
+    PrepareResult result = PREPARE_SUCCESS;
+    while (result == PREPARE_SUCCESS) {
+        if (*values != '(') {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        char* end = strchr(values, ')');
+        if (end == NULL) {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        *end = '\0';
+        char* id_string = values + 1;
+        char* username = strchr(id_string, ',');
+        char* email = username == NULL ? NULL : strchr(username + 1, ',');
+        if (email == NULL || strchr(email + 1, ',') != NULL) {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        *username++ = '\0';
+        *email++ = '\0';
+        id_string = trim_spaces(id_string);
+        username = trim_spaces(username);
+        email = trim_spaces(email);
+        if (*id_string == '\0' || *username == '\0' || *email == '\0') {
+            result = PREPARE_SYNTAX_ERROR;
+        } else {
+            if (statement->num_rows == capacity) {
+                capacity *= 2;
+                statement->rows = realloc(statement->rows, sizeof(Row) * capacity);
+            }
+            result = prepare_row(statement, statement->num_rows, &(statement->rows[statement->num_rows]),
+                                 id_string, username, email);
+            statement->num_rows++;
+        }
+
+        // 下一行之前是逗号，最后一行之后什么都没有
+        values = end + 1 + strspn(end + 1, " ");
+        if (*values == '\0') {
+            break;
+        }
+        if (*values != ',') {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        values += 1 + strspn(values + 1, " ");
+    }
+    if (result != PREPARE_SUCCESS) {
+        statement_free(statement);
+        statement->num_rows = 0;
+        statement->num_params = 0;
+    }
+    return result;
+}
+
+
+static PrepareResult prepare_insert(char* sql, Statement* statement) {
+    statement->type = STATEMENT_INSERT;
+    char* values = sql + strlen("insert");
+    values += strspn(values, " ");
+    if (*values == '(') {
+        return prepare_insert_values(values, statement);
+    }
+
+    // strtok用法，第一次使用的时候把str传进去，返回按分隔符分隔的第一个子字符串的地址
+    // 用可重入的strtok_r，解析进度保存在save里，多个线程可以同时解析
+    char* save;
+    strtok_r(sql, " ", &save); // 跳过insert关键字
+    char* id_string = strtok_r(NULL, " ", &save);
+    char* username = strtok_r(NULL, " ", &save);
+    char* email = strtok_r(NULL, " ", &save);
+
+    if (id_string == NULL || username == NULL || email == NULL) {
+        // 如果任何一个字段为空，则报错
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    // 检查通过之后将字符串拷贝进statement
+    PrepareResult result = prepare_row(statement, 0, &(statement->row_to_insert), id_string, username, email);
+    if (result != PREPARE_SUCCESS) {
+        statement_free(statement);
+        statement->num_params = 0;
+    }
+    return result;
+}
+
+
+/**
+ * 解析where条件，select和delete共用，支持：
+ *   where id = N
+ *   where id between A and B
+ * N、A、B都可以是占位符'?'，不带where时范围是整个表
+ * @param where where关键字，NULL表示没有条件
+ * @param save strtok_r的状态，接着读where之后的部分
+ * @param statement key_low、key_high已经初始化成整个表
+ * @return
+ */
+static PrepareResult prepare_where(char* where, char** save, Statement* statement) {
+    if (where == NULL) {
+        // 不带条件，整个表
+        return PREPARE_SUCCESS;
+    }
+
+    char* column = strtok_r(NULL, " ", save);
+    char* op = strtok_r(NULL, " ", save);
+    if (strcmp(where, "where") != 0 || column == NULL || op == NULL || strcmp(column, "id") != 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (strcmp(op, "=") == 0) {
+        char* id_string = strtok_r(NULL, " ", save);
+        if (id_string == NULL || strtok_r(NULL, " ", save) != NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        if (strcmp(id_string, "?") == 0) {
+            statement_add_param(statement, PARAM_KEY, 0);
+            return PREPARE_SUCCESS;
+        }
+        int id = atoi(id_string);
+        if (id < 0) {
+            return PREPARE_NEGATIVE_ID;
+        }
+        statement->key_low = id;
+        statement->key_high = id;
+        return PREPARE_SUCCESS;
+    }
+
+    if (strcmp(op, "between") == 0) {
+        char* low_string = strtok_r(NULL, " ", save);
+        char* and = strtok_r(NULL, " ", save);
+        char* high_string = strtok_r(NULL, " ", save);
+        if (low_string == NULL || and == NULL || high_string == NULL ||
+            strcmp(and, "and") != 0 || strtok_r(NULL, " ", save) != NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        int low = strcmp(low_string, "?") == 0 ? 0 : atoi(low_string);
+        int high = strcmp(high_string, "?") == 0 ? 0 : atoi(high_string);
+        if (low < 0 || high < 0) {
+            return PREPARE_NEGATIVE_ID;
+        }
+        statement->key_low = low;
+        statement->key_high = high;
+        if (strcmp(low_string, "?") == 0) {
+            statement_add_param(statement, PARAM_KEY_LOW, 0);
+        }
+        if (strcmp(high_string, "?") == 0) {
+            statement_add_param(statement, PARAM_KEY_HIGH, 0);
+        }
+        return PREPARE_SUCCESS;
+    }
+
+    return PREPARE_SYNTAX_ERROR;
+}
+
+/**
+ * 解析select语句，支持：
+ *   select [列, ...] [where ...]，列可以是*、id、username、email，不写时输出所有列，
+ * where条件见prepare_where
+ * @param sql 语句，解析时会被改写
+ * @param statement
+ * @return
+ */
+static PrepareResult prepare_select(char* sql, Statement* statement) {
+    statement->type = STATEMENT_SELECT;
+    statement->key_low = 0;
+    statement->key_high = UINT32_MAX;
+    statement->columns = 0;
+    statement->projection_count = 0;
+
+    char* save;
+    strtok_r(sql, " ", &save);
+    // 列名用空格或逗号分隔，一直到where为止
+    char* token = strtok_r(NULL, " ,", &save);
+    bool star = false;
+    while (token != NULL && strcmp(token, "where") != 0) {
+        Column projected;
+        if (strcmp(token, "*") == 0) {
+            star = true;
+            token = strtok_r(NULL, " ,", &save);
+            continue;
+        } else if (strcmp(token, "id") == 0) {
+            projected = COLUMN_ID;
+        } else if (strcmp(token, "username") == 0) {
+            projected = COLUMN_USERNAME;
+        } else if (strcmp(token, "email") == 0) {
+            projected = COLUMN_EMAIL;
+        } else {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        if (statement->columns & projected) {
+            // 同一列只能选一次
+            return PREPARE_SYNTAX_ERROR;
+        }
+        statement->columns |= projected;
+        statement->projection[statement->projection_count++] = projected;
+        token = strtok_r(NULL, " ,", &save);
+    }
+    if (star && statement->projection_count > 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (statement->projection_count == 0) {
+        statement->columns = COLUMN_ALL;
+        statement->projection[0] = COLUMN_ID;
+        statement->projection[1] = COLUMN_USERNAME;
+        statement->projection[2] = COLUMN_EMAIL;
+        statement->projection_count = 3;
+    }
+
+    return prepare_where(token, &save, statement);
+}
+
+/**
+ * 解析delete语句：delete where ...，where条件和select相同。
+ * 必须带where，避免漏写条件时删掉整个表
+ * @param sql 语句，解析时会被改写
+ * @param statement
+ * @return
+ */
+static PrepareResult prepare_delete(char* sql, Statement* statement) {
+    statement->type = STATEMENT_DELETE;
+    statement->key_low = 0;
+    statement->key_high = UINT32_MAX;
+
+    char* save;
+    strtok_r(sql, " ", &save);
+    char* where = strtok_r(NULL, " ", &save);
+    if (where == NULL) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    return prepare_where(where, &save, statement);
+}
+
+/**
+ * 解析sql语句
+ * @param sql 语句，解析时会被改写
+ * @param statement
+ * @return
+ */
+static PrepareResult prepare_statement(char* sql, Statement* statement) {
+    statement->rows = NULL;
+    statement->num_rows = 0;
+    statement->params = NULL;
+    statement->num_params = 0;
+    statement->projection_count = 0; // 只有select有结果列
+    // 识别插入
+    if (strncmp(sql, "insert", 6) == 0) {
+        // 只比较前6个字符，使用strncmp
+        statement->type = STATEMENT_INSERT;
+        return prepare_insert(sql, statement);
+    }
+    // 识别事务
+    if (strcmp(sql, "begin") == 0) {
+        statement->type = STATEMENT_BEGIN;
+        return PREPARE_SUCCESS;
+    }
+    if (strcmp(sql, "commit") == 0) {
+        statement->type = STATEMENT_COMMIT;
+        return PREPARE_SUCCESS;
+    }
+    if (strcmp(sql, "rollback") == 0) {
+        statement->type = STATEMENT_ROLLBACK;
+        return PREPARE_SUCCESS;
+    }
+    // 识别选择
+    if (strncmp(sql, "select", 6) == 0 &&
+        (sql[6] == '\0' || sql[6] == ' ')) {
+        return prepare_select(sql, statement);
+    }
+    // 识别删除
+    if (strncmp(sql, "delete", 6) == 0 &&
+        (sql[6] == '\0' || sql[6] == ' ')) {
+        return prepare_delete(sql, statement);
+    }
+    // 如果到这里都没有识别出来，返回未识别成功
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+}
+
+
+
+/**
+ * 行序列化成cell之后的长度
+ * @param source
+ * @param base_key 所在叶子的key基准值
+ * @return 字节数
+ */
+static uint32_t row_cell_size(Row* source, uint32_t base_key) {
+    return varint_size(source->id - base_key) + 2 * LEAF_NODE_LENGTH_SIZE + strlen(source->username) + strlen(source->email);
+}
+
+/**
+ * 将当前行序列化成叶子节点的cell：key差值 + 长度前缀的username和email
+ * @param source 当前行的地址
+ * @param base_key 所在叶子的key基准值，不能大于source->id
+ * @param destination 目标内存的地址，至少有row_cell_size个字节
+ */
+static void serialize_row(Row* source, uint32_t base_key, void* destination) {
+    uint8_t username_length = strlen(source->username);
+    uint8_t email_length = strlen(source->email);
+    destination += varint_encode(source->id - base_key, destination);
+    *(uint8_t*)destination = username_length;
+    memcpy(destination + LEAF_NODE_LENGTH_SIZE, source->username, username_length);
+    destination += LEAF_NODE_LENGTH_SIZE + username_length;
+    *(uint8_t*)destination = email_length;
+    memcpy(destination + LEAF_NODE_LENGTH_SIZE, source->email, email_length);
+}
+
+/**
+ * 把cell解码成行视图，只解析用到的列；id总是解码，范围判断要用
+ * @param source cell的地址
+ * @param base_key 所在叶子的key基准值
+ * @param columns 要用到的列
+ * @param view
+ */
+static void row_view_decode(void* source, uint32_t base_key, uint32_t columns, RowView* view) {
+    uint32_t delta;
+    source += varint_decode(source, &delta);
+    view->id = base_key + delta;
+    if ((columns & (COLUMN_USERNAME | COLUMN_EMAIL)) == 0) {
+        return;
+    }
+    view->username_length = *(uint8_t*)source;
+    view->username = source + LEAF_NODE_LENGTH_SIZE;
+    source += LEAF_NODE_LENGTH_SIZE + view->username_length;
+    view->email_length = *(uint8_t*)source;
+    view->email = source + LEAF_NODE_LENGTH_SIZE;
+}
+
+/**
+ * 把读取用的cursor指向的cell解码成行视图，视图在cursor离开这个叶子之前有效
+ * @param cursor
+ * @param columns 要用到的列
+ * @param view
+ */
+static void cursor_row_view(Cursor* cursor, uint32_t columns, RowView* view) {
+    void* node = cursor->node;
+    row_view_decode(leaf_node_cell(node, cursor->cell_num), *leaf_node_base_key(node), columns, view);
+}
+
+/**
+ * 获取一个还没有使用的页编号：先重用空闲页，没有空闲页时追加在文件末尾
+ * @param pager
+ * @return 新页编号
+ */
+static uint32_t get_unused_page_num(Pager* pager) {
+    if (pager->free_pages.count == 0) {
+        return pager->num_pages;
+    }
+    uint32_t page_num = pager->free_pages.pages[--pager->free_pages.count];
+    pager->free_list_dirty = true;
+    if (!pager_page_writable(pager, page_num)) {
+        // 写时复制模式下空闲页没有被meta引用，在位图中记下来，可以原地修改
+        if (page_num / 8 >= pager->reused_pages_size) {
+            uint32_t size = pager->fresh_page_num / 8 + 1;
+            pager->reused_pages = realloc(pager->reused_pages, size);
+            memset(pager->reused_pages + pager->reused_pages_size, 0, size - pager->reused_pages_size);
+            pager->reused_pages_size = size;
+        }
+        pager->reused_pages[page_num / 8] |= 1 << (page_num % 8);
+    }
+    return page_num;
+}
+
+/**
+ * 空闲页链表中记录的页编号是否可能合法：在文件里，不是meta页和根页，也没有出现过。
+ * 合法时在seen中记下它，链表成环或者一页出现两次都会被发现
+ * @param pager
+ * @param seen 每页一位的位图
+ * @param page_num
+ * @return
+ */
+static bool free_list_page_valid(Pager* pager, uint8_t* seen, uint32_t page_num) {
+    if (page_num < META_PAGES || page_num >= pager->num_pages || page_num == pager->root_page_num ||
+        (seen[page_num / 8] & (1 << (page_num % 8))) != 0) {
+        return false;
+    }
+    seen[page_num / 8] |= 1 << (page_num % 8);
+    return true;
+}
+
+/**
+ * 打开数据库时读入空闲页链表
+ * @param pager
+ * @return 链表损坏时返回false：有不是空闲页链表的页、记录数超过一页能放下的数目、
+ *         页编号超出文件或者指向meta页和根页、同一页出现两次(包括链表成环)
+ */
+static bool pager_load_free_list(Pager* pager) {
+    uint8_t* seen = calloc(pager->num_pages / 8 + 1, 1);
+    bool valid = true;
+    uint32_t page_num = pager->free_list_head;
+    while (valid && page_num != 0) {
+        if (!free_list_page_valid(pager, seen, page_num)) {
+            valid = false;
+            break;
+        }
+        void* node = get_page(pager, page_num);
+        uint32_t count = *(uint32_t*)(node + FREE_LIST_COUNT_OFFSET);
+        if (get_node_type(node) != NODE_FREE_LIST || count > FREE_LIST_MAX_PAGES) {
+            valid = false;
+            count = 0;
+        }
+        page_list_push(&(pager->free_list_pages), page_num);
+        uint32_t* entries = node + FREE_LIST_HEADER_SIZE;
+        for (uint32_t i = 0; i < count && valid; i++) {
+            valid = free_list_page_valid(pager, seen, entries[i]);
+            page_list_push(&(pager->free_pages), entries[i]);
+        }
+        uint32_t next = *(uint32_t*)(node + FREE_LIST_NEXT_OFFSET);
+        unpin_page(pager, page_num);
+        page_num = next;
+    }
+    free(seen);
+    return valid;
+}
+
+/**
+ * 持久化之前把空闲页重写成链表，链表页本身从空闲页中取，不够时追加在文件末尾。
+ * 普通模式下旧的链表页直接重用，和meta页一起经过wal写出去；
+ * 写时复制模式下旧的链表页还被最近一次写的meta引用，要等下次写meta之后才能重用。
+ * 只能在语句之间由修改b树的线程调用
+ * @param pager
+ */
+static void pager_save_free_list(Pager* pager) {
+    if (!pager->free_list_dirty) {
+        return;
+    }
+    PageList* trunks = &(pager->free_list_pages);
+    for (uint32_t i = 0; i < trunks->count; i++) {
+        pager_free_page(pager, trunks->pages[i]);
+    }
+    trunks->count = 0;
+    // 链表页从空闲页中取走之后要记录的页也少了，每取一页重新算一次
+    while ((uint64_t)trunks->count * FREE_LIST_MAX_PAGES < pager->free_pages.count + pager->pending_free.count) {
+        uint32_t page_num = get_unused_page_num(pager);
+        get_page_for_write(pager, page_num);
+        unpin_page(pager, page_num);
+        page_list_push(trunks, page_num);
+    }
+
+    uint32_t total = pager->free_pages.count + pager->pending_free.count;
+    uint32_t next_entry = 0;
+    for (uint32_t i = 0; i < trunks->count; i++) {
+        void* node = get_page_for_write(pager, trunks->pages[i]);
+        set_node_type(node, NODE_FREE_LIST);
+        set_node_root(node, false);
+        *(uint32_t*)(node + FREE_LIST_NEXT_OFFSET) = i + 1 < trunks->count ? trunks->pages[i + 1] : 0;
+        uint32_t* entries = node + FREE_LIST_HEADER_SIZE;
+        uint32_t count = 0;
+        for (; count < FREE_LIST_MAX_PAGES && next_entry < total; count++, next_entry++) {
+            entries[count] = next_entry < pager->free_pages.count ? pager->free_pages.pages[next_entry] :
+                    pager->pending_free.pages[next_entry - pager->free_pages.count];
+        }
+        *(uint32_t*)(node + FREE_LIST_COUNT_OFFSET) = count;
+        unpin_page(pager, trunks->pages[i]);
+        pthread_mutex_lock(&(pager->mutex));
+        // 链表很长时有副本的帧不能被淘汰，扩大缓冲池或者先发布已经写好的链表页
+        pager_limit_pending(pager, 0);
+        pthread_mutex_unlock(&(pager->mutex));
+    }
+    pager->free_list_head = trunks->count > 0 ? trunks->pages[0] : 0;
+    pager->free_list_dirty = false;
+}
+
+/**
+ * 写时复制模式下修改page_num之前先把它复制到新页，上次写meta之后分配的页和重用的空闲页直接原地修改
+ * @param pager
+ * @param page_num
+ * @return 可以修改的页号
+ */
+static uint32_t pager_copy_page(Pager* pager, uint32_t page_num) {
+    if (pager_page_writable(pager, page_num)) {
+        return page_num;
+    }
+    void* node = get_page(pager, page_num);
+    uint32_t copy_page_num = get_unused_page_num(pager);
+    void* copy = get_page_for_write(pager, copy_page_num);
+    memcpy(copy, node, PAGE_SIZE);
+    unpin_page(pager, copy_page_num);
+    unpin_page(pager, page_num);
+    // 旧页在下次写meta之后就没有用了
+    pager_free_page(pager, page_num);
+    return copy_page_num;
+}
+
+/**
+ * 写时复制模式下修改叶子之前调用：从根到叶子逐层复制，父节点(已经是新页)的孩子指针指向复制出来的页，
+ * 根被复制时换掉写线程看到的根。旧的页保持原样，最近一次meta引用的树一直完整
+ * @param cursor 记录了下降路径的cursor，路径上的页号换成复制后的页
+ */
+static void cursor_copy_path(Cursor* cursor) {
+    Pager* pager = cursor->table->pager;
+    for (uint32_t level = 0; level <= cursor->depth; level++) {
+        uint32_t page_num = level < cursor->depth ? cursor->path[level].page_num : cursor->page_num;
+        uint32_t copy_page_num = pager_copy_page(pager, page_num);
+        if (copy_page_num == page_num) {
+            continue;
+        }
+        if (level == 0) {
+            pager->root_page_num = copy_page_num;
+        } else {
+            PathEntry* parent = &(cursor->path[level - 1]);
+            void* node = get_page_for_write(pager, parent->page_num);
+            *internal_node_child(node, parent->child_index) = copy_page_num;
+            unpin_page(pager, parent->page_num);
+        }
+        if (level < cursor->depth) {
+            cursor->path[level].page_num = copy_page_num;
+        } else {
+            cursor->page_num = copy_page_num;
+        }
+    }
+}
+
+/**
+ * 在叶子节点中二分查找key应该在的位置
+ * @param node
+ * @param key
+ * @return 第一个大于等于key的cell号，都比key小时返回num_cells
+ */
+static uint32_t leaf_node_find(void* node, uint32_t key) {
+    uint32_t min_index = 0;
+    uint32_t one_past_max_index = *leaf_node_num_cells(node);
+    while (one_past_max_index != min_index) {
+        uint32_t index = (min_index + one_past_max_index) / 2;
+        uint32_t key_at_index = leaf_node_key(node, index);
+        if (key == key_at_index) {
+            return index;
+        }
+        if (key < key_at_index) {
+            one_past_max_index = index;
+        } else {
+            min_index = index + 1;
+        }
+    }
+    return min_index;
+}
+
+/**
+ * 创建还没有定位的cursor
+ * @param table
+ * @param read_ahead 移动到下一个叶子时是否预读
+ * @return
+ */
+static Cursor* cursor_new(Table* table, bool read_ahead) {
+    Cursor* cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->depth = 0;
+    cursor->end_of_table = false;
+    cursor->read_ahead = read_ahead;
+    cursor->prefetch_parent = 0;
+    cursor->prefetch_end = 0;
+    cursor->upper_bound = UINT32_MAX;
+    cursor->node = NULL;
+    return cursor;
+}
+
+/**
+ * 预读cursor所在叶子右边的几个兄弟叶子，范围扫描接下来会按顺序访问它们。
+ * 预读窗口用掉一半之后才补满，避免每个叶子都提交一次
+ * @param cursor 刚下降到叶子的cursor
+ * @param parent 叶子的父节点，调用者pin住了它
+ */
+static void cursor_read_ahead(Cursor* cursor, void* parent) {
+    Pager* pager = cursor->table->pager;
+    if (pager->read_ahead == 0) {
+        return;
+    }
+    PathEntry* entry = &(cursor->path[cursor->depth - 1]);
+    uint32_t start = entry->child_index + 1;
+    if (entry->page_num == cursor->prefetch_parent && cursor->prefetch_end > start) {
+        if (cursor->prefetch_end - start > pager->read_ahead / 2) {
+            return;
+        }
+        start = cursor->prefetch_end;
+    }
+    uint32_t end = entry->child_index + 1 + pager->read_ahead;
+
+    uint32_t num_keys = *internal_node_num_keys(parent);
+    if (end > num_keys + 1) {
+        end = num_keys + 1;
+    }
+    uint32_t page_nums[pager->read_ahead];
+    uint32_t count = 0;
+    for (uint32_t i = start; i < end; i++) {
+        page_nums[count++] = *internal_node_child(parent, i);
+    }
+    cursor->prefetch_parent = entry->page_num;
+    cursor->prefetch_end = end;
+    pager_prefetch(pager, page_nums, count);
+}
+
+/**
+ * 从根节点开始下降到key所在(或应该插入)的叶子，经过的内部节点记录在cursor->path中，
+ * 同时记下叶子能容纳的最大key。
+ * at_snapshot为true时读cursor快照中的页，停下时叶子不解除pin，内容记在cursor->node；
+ * 为false时读最新的内容，包括还没提交的修改，只有持有写锁的线程这样下降
+ * @param cursor
+ * @param key
+ * @param at_snapshot
+ * @return b树损坏时记下错误返回false，cursor停在表尾，不pin任何页
+ */
+static bool cursor_descend(Cursor* cursor, uint32_t key, bool at_snapshot) {
+    Pager* pager = cursor->table->pager;
+    cursor->depth = 0;
+    cursor->upper_bound = UINT32_MAX;
+    uint32_t page_num = at_snapshot ? cursor->snapshot.root_page_num : pager->root_page_num;
+    void* node = at_snapshot ? get_page_at(pager, page_num, &(cursor->snapshot)) : get_page(pager, page_num);
+    while (get_node_type(node) == NODE_INTERNAL && cursor->depth < BTREE_MAX_DEPTH) {
+        uint32_t child_index = internal_node_find_child(node, key);
+        if (child_index < *internal_node_num_keys(node)) {
+            // 孩子中的key都不超过它的分隔key，越往下越紧
+            cursor->upper_bound = internal_node_key(node, child_index);
+        }
+        cursor->path[cursor->depth].page_num = page_num;
+        cursor->path[cursor->depth].child_index = child_index;
+        cursor->depth++;
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        void* child = at_snapshot ? get_page_at(pager, child_page_num, &(cursor->snapshot)) :
+                      get_page(pager, child_page_num);
+        if (cursor->read_ahead && get_node_type(child) == NODE_LEAF) {
+            cursor_read_ahead(cursor, node);
+        }
+        unpin_page(pager, page_num);
+        node = child;
+        page_num = child_page_num;
+    }
+    if (get_node_type(node) != NODE_LEAF) {
+        // 深度超过上限(孩子指针成环)，或者走到了不属于b树的页
+        pager_fail(pager, EXECUTE_CORRUPT);
+        unpin_page(pager, page_num);
+        cursor->node = NULL;
+        cursor->end_of_table = true;
+        return false;
+    }
+
+    cursor->page_num = page_num;
+    cursor->cell_num = leaf_node_find(node, key);
+    if (at_snapshot) {
+        cursor->node = node;
+    } else {
+        unpin_page(pager, page_num);
+    }
+    return true;
+}
+
+/**
+ * 返回指向key所在位置(或应该插入的位置)的cursor，给修改b树的线程使用
+ * @param table
+ * @param key
+ * @return Cursor实例，b树损坏时返回NULL
+ */
+static Cursor* table_find(Table* table, uint32_t key) {
+    Cursor* cursor = cursor_new(table, false);
+    if (!cursor_descend(cursor, key, false)) {
+        free(cursor);
+        return NULL;
+    }
+    return cursor;
+}
+
+/**
+ * 把cursor移动到下一个叶子的第一个cell：释放当前叶子，在快照中从根重新下降到upper_bound + 1所在的叶子。
+ * 快照中的页不会变，下降经过的内部节点通常都还在缓冲池中
+ * @param cursor
+ */
+static void cursor_next_leaf(Cursor* cursor) {
+    Pager* pager = cursor->table->pager;
+    while (true) {
+        unpin_page(pager, cursor->page_num);
+        cursor->node = NULL;
+        if (cursor->upper_bound == UINT32_MAX) {
+            // 没有更右边的叶子了
+            cursor->end_of_table = true;
+            return;
+        }
+        if (!cursor_descend(cursor, cursor->upper_bound + 1, true) ||
+            cursor->cell_num < *leaf_node_num_cells(cursor->node)) {
+            return;
+        }
+    }
+}
+
+/**
+ * 创建指向第一个大于等于key的行的cursor，用于读取，用完调用cursor_close。
+ * cursor在创建时开始一个快照，之后只读快照中的页，不受同时进行的插入影响，也不会挡住插入。
+ * 和table_find不同，key比所在叶子的所有key都大时会移动到下一个叶子
+ * @param table
+ * @param key
+ * @param read_ahead 范围扫描时预读后面的叶子
+ * @return Cursor实例
+ */
+static Cursor* table_seek(Table* table, uint32_t key, bool read_ahead) {
+    Cursor* cursor = cursor_new(table, read_ahead);
+    pager_snapshot_begin(table->pager, &(cursor->snapshot));
+    if (cursor_descend(cursor, key, true) && cursor->cell_num >= *leaf_node_num_cells(cursor->node)) {
+        cursor_next_leaf(cursor);
+    }
+    return cursor;
+}
+
+/**
+ * 释放读取用的cursor：解除所在叶子的pin，结束快照
+ * @param cursor
+ */
+static void cursor_close(Cursor* cursor) {
+    if (cursor->node != NULL) {
+        unpin_page(cursor->table->pager, cursor->page_num);
+    }
+    pager_snapshot_end(cursor->table->pager, &(cursor->snapshot));
+    free(cursor);
+}
+
+/**
+ * 移动读取用的cursor
+ * @param cursor
+ */
+static void cursor_advance(Cursor* cursor) {
+//    cursor->row_num += 1;
+    cursor->cell_num += 1; // cell 加 1
+//    if (cursor->row_num >= cursor->table->num_rows) {
+    if (cursor->cell_num >= *leaf_node_num_cells(cursor->node)) {
+        // 当前叶子走完了，移动到下一个叶子
+        cursor_next_leaf(cursor);
+    }
+}
+
+/**
+ * 打印缩进
+ * @param level
+ */
+static void indent(uint32_t level) {
+    for (uint32_t i = 0; i < level; i++) {
+        printf("  ");
+    }
+}
+
+/**
+ * 递归打印b树
+ * @param pager
+ * @param page_num 子树的根
+ * @param indentation_level 缩进层级
+ * @param snapshot 打印哪个版本的树
+ */
+static void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level, Snapshot* snapshot) {
+    void* node = get_page_at(pager, page_num, snapshot);
+    uint32_t num_keys, child;
+
+    switch (get_node_type(node)) {
+        case (NODE_LEAF):
+            num_keys = *leaf_node_num_cells(node);
+            indent(indentation_level);
+            printf("- leaf (size %d)\n", num_keys);
+            for (uint32_t i = 0; i < num_keys; i++) {
+                indent(indentation_level + 1);
+                printf("- %d\n", leaf_node_key(node, i));
+            }
+            unpin_page(pager, page_num);
+            break;
+        case (NODE_INTERNAL):
+            num_keys = *internal_node_num_keys(node);
+            indent(indentation_level);
+            printf("- internal (size %d)\n", num_keys);
+            for (uint32_t i = 0; i < num_keys; i++) {
+                child = *internal_node_child(node, i);
+                // 递归时不占着这一页，打印完孩子再重新获取
+                unpin_page(pager, page_num);
+                print_tree(pager, child, indentation_level + 1, snapshot);
+                node = get_page_at(pager, page_num, snapshot);
+                indent(indentation_level + 1);
+                printf("- key %d\n", internal_node_key(node, i));
+            }
+            child = *internal_node_right_child(node);
+            unpin_page(pager, page_num);
+            print_tree(pager, child, indentation_level + 1, snapshot);
+            break;
+        case (NODE_FREE_LIST):
+            // 空闲页链表的页不应该出现在b树里，打印出来，之后的语句返回EXECUTE_CORRUPT
+            indent(indentation_level);
+            printf("- 损坏：第%d页是空闲页链表的页\n", page_num);
+            unpin_page(pager, page_num);
+            pager_fail(pager, EXECUTE_CORRUPT);
+            break;
+    }
+}
+
+/**
+ * 默认的打开选项
+ * @return
+ */
+DbOptions default_db_options() {
+    DbOptions options;
+    options.num_frames = PAGER_DEFAULT_FRAMES;
+    options.use_wal = true;
+    options.wal_group_size = WAL_DEFAULT_GROUP_SIZE;
+    options.use_mmap = false;
+    options.read_ahead = PAGER_DEFAULT_READ_AHEAD;
+    options.use_direct_io = false;
+    options.copy_on_write = false;
+    options.output_mode = OUTPUT_TABLE;
+    return options;
+}
+
+/**
+ * 表table的初始化函数
+ * @param filename
+ * @param options 打开选项
+ * @return
+ */
+static ExecuteResult table_insert(Table* table, Row* row_to_insert);
+static void wal_replay(Table* table);
+
+Table *db_open(const char *filename, DbOptions* options, OpenResult* result) {
+    Pager* pager = pager_open(filename, options, result);
+    if (pager == NULL) {
+        return NULL;
+    }
+//    uint32_t num_rows = pager->file_length / ROW_SIZE;
+    Table* table = (Table*) malloc(sizeof(Table));
+    table->pager = pager;
+//    table->num_rows = num_rows;
+    table->sink = result_sink_open(options->output_mode);
+    table->in_transaction = false;
+    table->batch = NULL;
+    table->batch_length = 0;
+    table->batch_capacity = 0;
+    pthread_mutex_init(&(table->write_lock), NULL);
+    if (!pager_load_free_list(pager)) {
+        pager_fail(pager, EXECUTE_CORRUPT);
+    }
+    bool created = pager->root_page_num >= pager->num_pages;
+    if (created) {
+        // 这是个新的db文件，初始化
+        uint32_t root_page_num = pager->root_page_num;
+        void* root_node = get_page_for_write(pager, root_page_num);
+        initialize_leaf_node(root_node); // 初始化根页
+        set_node_root(root_node, true);
+        unpin_page(pager, root_page_num);
+        pager_commit(pager);
+    }
+    if (pager->wal != NULL && pager_error(pager) == EXECUTE_SUCCESS) {
+        // 上次没有正常关闭，重放wal中的插入
+        wal_replay(table);
+    }
+    if (created) {
+        // 新文件马上写出根页和文件头，下次打开才认得出来
+        if (pager->copy_on_write) {
+            pager_cow_sync(pager);
+        } else {
+            pager_checkpoint(pager);
+        }
+    }
+//    table->num_rows = 0;
+//    for(uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
+//        // 一开始pages都是NULL，只有在访问的时候才分配内存
+//        table->pages[i] = NULL;
+//    }
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        // 打开失败不写数据库文件，wal留给下次恢复
+        *result = pager_error(pager) == EXECUTE_CORRUPT ? OPEN_CORRUPT : OPEN_IO_ERROR;
+        db_close(table);
+        return NULL;
+    }
+    return table;
+}
+
+/**
+ * 根节点分裂：根节点留在原来的页，把旧根的内容拷贝到新的左孩子，
+ * 再把根重新初始化成有两个孩子的内部节点
+ * @param table
+ * @param left_max_key 左孩子中最大的key
+ * @param right_child_page_num 分裂出来的右孩子
+ */
+static void create_new_root(Table* table, uint32_t left_max_key, uint32_t right_child_page_num) {
+    Pager* pager = table->pager;
+    uint32_t root_page_num = pager->root_page_num;
+    void* root = get_page_for_write(pager, root_page_num);
+    uint32_t left_child_page_num = get_unused_page_num(pager);
+    void* left_child = get_page_for_write(pager, left_child_page_num);
+
+    // 旧根变成左孩子
+    memcpy(left_child, root, PAGE_SIZE);
+    set_node_root(left_child, false);
+
+    initialize_internal_node(root);
+    set_node_root(root, true);
+    uint32_t children[] = {left_child_page_num, right_child_page_num};
+    internal_node_fill(root, children, &left_max_key, 1);
+
+    unpin_page(pager, left_child_page_num);
+    unpin_page(pager, root_page_num);
+}
+
+/**
+ * 子节点分裂后更新父节点：父节点是cursor->path[level]，
+ * 原来指向分裂节点的孩子位置换成 (left_page_num, left_max_key) 和 right_page_num 两个孩子。
+ * 父节点放不下时继续分裂，分隔key向上传递
+ * @param cursor 记录了下降路径的cursor
+ * @param level 父节点在path中的层
+ * @param left_page_num 分裂后的左节点(就是原来的节点)
+ * @param left_max_key 左节点中最大的key
+ * @param right_page_num 分裂出来的右节点
+ */
+static void internal_node_insert(Cursor* cursor, uint32_t level, uint32_t left_page_num,
+                                 uint32_t left_max_key, uint32_t right_page_num) {
+    Table* table = cursor->table;
+    uint32_t parent_page_num = cursor->path[level].page_num;
+    uint32_t index = cursor->path[level].child_index;
+    void* parent = get_page_for_write(table->pager, parent_page_num);
+    uint32_t num_keys = *internal_node_num_keys(parent);
+
+    // key是差值编码的，插入新key可能改变基准值和宽度，所以先在临时数组里完成插入再整体重写
+    uint32_t children[INTERNAL_NODE_MAX_CELLS + 2];
+    uint32_t keys[INTERNAL_NODE_MAX_CELLS + 1];
+    for (uint32_t i = 0, j = 0; i <= num_keys; i++, j++) {
+        if (i == index) {
+            children[j] = left_page_num;
+            keys[j] = left_max_key;
+            j++;
+            children[j] = right_page_num;
+        } else {
+            children[j] = *internal_node_child(parent, i);
+        }
+        if (i < num_keys) {
+            keys[j] = internal_node_key(parent, i);
+        }
+    }
+    uint32_t total_keys = num_keys + 1;
+    if (total_keys <= internal_node_max_keys(internal_key_width(keys[total_keys - 1] - keys[0]))) {
+        internal_node_fill(parent, children, keys, total_keys);
+        unpin_page(table->pager, parent_page_num);
+        return;
+    }
+
+    // 父节点放不下，对半分到两个节点
+    uint32_t split_index = total_keys / 2;
+    uint32_t separator = keys[split_index]; // 左节点的最大key
+
+    uint32_t new_page_num = get_unused_page_num(table->pager);
+    void* new_node = get_page_for_write(table->pager, new_page_num);
+    initialize_internal_node(new_node);
+
+    // 左半部分留在原来的页，右半部分放到新页
+    internal_node_fill(parent, children, keys, split_index);
+    internal_node_fill(new_node, children + split_index + 1, keys + split_index + 1, total_keys - split_index - 1);
+    unpin_page(table->pager, new_page_num);
+    unpin_page(table->pager, parent_page_num);
+
+    if (level == 0) {
+        create_new_root(table, separator, new_page_num);
+    } else {
+        internal_node_insert(cursor, level - 1, parent_page_num, separator, new_page_num);
+    }
+}
+
+/**
+ * 把一组cell按顺序重新写进叶子节点，cell从页尾开始紧凑排列
+ * 基准值取第一个key，每个cell的key按新的基准值重新编码
+ * @param node 已经初始化的叶子节点
+ * @param cells cell的地址，不能指向node本身
+ * @param keys 每个cell解码后的key，从小到大
+ * @param count cell个数
+ */
+static void leaf_node_fill(void* node, void** cells, uint32_t* keys, uint32_t count) {
+    uint32_t base_key = count > 0 ? keys[0] : 0;
+    uint32_t content_start = PAGE_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta;
+        uint32_t old_key_size = varint_decode(cells[i], &delta);
+        uint32_t payload_size = leaf_cell_size(cells[i]) - old_key_size;
+        content_start -= varint_size(keys[i] - base_key) + payload_size;
+        uint32_t key_size = varint_encode(keys[i] - base_key, node + content_start);
+        memcpy(node + content_start + key_size, cells[i] + old_key_size, payload_size);
+        *leaf_node_slot(node, i) = content_start;
+    }
+    *leaf_node_num_cells(node) = count;
+    *leaf_node_content_start(node) = content_start;
+    *leaf_node_base_key(node) = base_key;
+}
+
+/**
+ * 叶子节点不能原地插入新cell时(空间不够，或者新key比基准值小)，按新的基准值重写；
+ * 还是放不下就新建一个叶子，把原有cell和新cell按字节数平分到两个叶子中，然后更新父节点
+ * @param cursor
+ * @param key
+ * @param value
+ */
+static void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value) {
+    Pager* pager = cursor->table->pager;
+    void* old_node = get_page_for_write(pager, cursor->page_num);
+
+    // 旧节点要原地重写，先拷贝一份，再把新cell按顺序插进cell列表
+    char old_copy[PAGE_SIZE];
+    memcpy(old_copy, old_node, PAGE_SIZE);
+    char new_cell[LEAF_NODE_MAX_CELL_SIZE];
+    serialize_row(value, key, new_cell);
+    uint32_t num_cells = *leaf_node_num_cells(old_copy) + 1;
+    void* cells[num_cells];
+    uint32_t keys[num_cells];
+    for (uint32_t i = 0; i < num_cells; i++) {
+        if (i == cursor->cell_num) {
+            cells[i] = new_cell;
+            keys[i] = key;
+        } else {
+            uint32_t old_num = i < cursor->cell_num ? i : i - 1;
+            cells[i] = leaf_node_cell(old_copy, old_num);
+            keys[i] = leaf_node_key(old_copy, old_num);
+        }
+    }
+    // 按第一个key作基准值计算大小，分裂后右半边的差值只会更小
+    uint32_t sizes[num_cells];
+    uint32_t total_size = 0;
+    for (uint32_t i = 0; i < num_cells; i++) {
+        uint32_t delta;
+        sizes[i] = leaf_cell_size(cells[i]) - varint_decode(cells[i], &delta) +
+                varint_size(keys[i] - keys[0]) + LEAF_NODE_SLOT_SIZE;
+        total_size += sizes[i];
+    }
+    initialize_leaf_node(old_node);
+    set_node_root(old_node, is_node_root(old_copy));
+    if (total_size <= LEAF_NODE_SPACE_FOR_CELLS) {
+        // 换了基准值之后放得下，不用分裂
+        leaf_node_fill(old_node, cells, keys, num_cells);
+        unpin_page(pager, cursor->page_num);
+        return;
+    }
+
+    uint32_t new_page_num = get_unused_page_num(pager);
+    void* new_node = get_page_for_write(pager, new_page_num);
+    initialize_leaf_node(new_node);
+
+    // 左边装到一半字节数为止，两边都至少有一个cell
+    uint32_t left_count = 0;
+    uint32_t left_size = 0;
+    while (left_count < num_cells - 1 && (left_count == 0 || left_size < total_size / 2)) {
+        left_size += sizes[left_count];
+        left_count++;
+    }
+    leaf_node_fill(old_node, cells, keys, left_count);
+    leaf_node_fill(new_node, cells + left_count, keys + left_count, num_cells - left_count);
+
+    uint32_t left_max_key = leaf_node_key(old_node, left_count - 1);
+    unpin_page(pager, cursor->page_num);
+    unpin_page(pager, new_page_num);
+
+    if (cursor->depth == 0) {
+        create_new_root(cursor->table, left_max_key, new_page_num);
+    } else {
+        internal_node_insert(cursor, cursor->depth - 1, cursor->page_num, left_max_key, new_page_num);
+    }
+}
+
+/**
+ * 在cursor处插入一个cell
+ * @param cursor
+ * @param key
+ * @param value
+ */
+static void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value) {
+    void* node = get_page_for_write(cursor->table->pager, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_cells == 0) {
+        *leaf_node_base_key(node) = key;
+    }
+    uint32_t base_key = *leaf_node_base_key(node);
+    // 看下能不能按当前基准值装下要插入的cell和它的slot，不能就重写或者分裂
+    if (key < base_key || leaf_node_free_space(node) < row_cell_size(value, base_key) + LEAF_NODE_SLOT_SIZE) {
+        unpin_page(cursor->table->pager, cursor->page_num);
+        leaf_node_split_and_insert(cursor, key, value);
+        return;
+    }
+
+    // cell放在内容区的最前面，slot数组中cell_num之后的slot往后移动
+    PageOffset content_start = *leaf_node_content_start(node) - row_cell_size(value, base_key);
+    serialize_row(value, base_key, node + content_start);
+    memmove(leaf_node_slot(node, cursor->cell_num + 1), leaf_node_slot(node, cursor->cell_num),
+            (num_cells - cursor->cell_num) * LEAF_NODE_SLOT_SIZE);
+    *leaf_node_slot(node, cursor->cell_num) = content_start;
+    *leaf_node_content_start(node) = content_start;
+    *(leaf_node_num_cells(node)) += 1;
+    unpin_page(cursor->table->pager, cursor->page_num);
+}
+
+/**
+ * 叶子能不能不分裂、不换基准值直接插入这一行
+ * @param node
+ * @param row
+ * @return
+ */
+static bool leaf_node_fits(void* node, Row* row) {
+    uint32_t base_key = *leaf_node_num_cells(node) > 0 ? *leaf_node_base_key(node) : row->id;
+    return row->id >= base_key && leaf_node_free_space(node) >= row_cell_size(row, base_key) + LEAF_NODE_SLOT_SIZE;
+}
+
+/**
+ * 把一行插入b树，不写wal，调用者持有表的写锁
+ * @param table
+ * @param row_to_insert
+ * @return 执行结果
+ */
+static ExecuteResult table_insert(Table* table, Row* row_to_insert) {
+    // 下降到key应该在的叶子
+    Cursor* cursor = table_find(table, row_to_insert->id);
+    if (cursor == NULL) {
+        return EXECUTE_CORRUPT;
+    }
+    // 路径上每个节点最坏都要分裂，再加上新根；写时复制模式下路径上每一页还要复制
+    uint32_t copies = table->pager->copy_on_write ? cursor->depth + 1 : 0;
+    pager_reserve_frames(table->pager, 2 * (cursor->depth + 2) + copies);
+
+    void* node = get_page(table->pager, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    bool duplicate = cursor->cell_num < num_cells && leaf_node_key(node, cursor->cell_num) == row_to_insert->id;
+    bool full = !leaf_node_fits(node, row_to_insert);
+    unpin_page(table->pager, cursor->page_num);
+    if (duplicate) {
+        // 主键已经存在
+        free(cursor);
+        return EXECUTE_DUPLICATE_KEY;
+    }
+    // 最坏情况下叶子、路径上的每个内部节点都要分裂，根节点还要多一页，页数不够时报满表错误
+    if ((uint64_t)table->pager->num_pages + (full ? cursor->depth + 2 : 0) + copies > TABLE_MAX_PAGES) {
+        free(cursor);
+        return EXECUTE_TABLE_FULL;
+    }
+//    // 将statement中的row入表
+//    serialize_row(row_to_insert, cursor_value(cursor));
+//    // 表的行数加一
+//    table->num_rows += 1;
+    if (table->pager->copy_on_write) {
+        cursor_copy_path(cursor);
+    }
+    leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
+
+    free(cursor);
+    return EXECUTE_SUCCESS;
+}
+
+static int compare_row_id(const void* a, const void* b) {
+    uint32_t left = ((const Row*)a)->id;
+    uint32_t right = ((const Row*)b)->id;
+    return left < right ? -1 : (left > right);
+}
+
+/**
+ * 检查一批按id排好序的行能不能全部插入：批内和表里都不能有重复的id。
+ * skip_existing为true时表里已经有的id不算错误，这些行从批中去掉，剩下的行依次前移。
+ * 同一个叶子里的行只下降一次
+ * @param table
+ * @param rows
+ * @param count 输入行数，输出剩下的行数
+ * @param skip_existing
+ * @return
+ */
+static ExecuteResult table_check_batch(Table* table, Row* rows, uint32_t* count, bool skip_existing) {
+    for (uint32_t i = 1; i < *count; i++) {
+        if (rows[i].id == rows[i - 1].id) {
+            return EXECUTE_DUPLICATE_KEY;
+        }
+    }
+    uint32_t i = 0;
+    uint32_t kept = 0;
+    while (i < *count) {
+        Cursor* cursor = table_find(table, rows[i].id);
+        if (cursor == NULL) {
+            return EXECUTE_CORRUPT;
+        }
+        uint32_t copies = table->pager->copy_on_write ? cursor->depth + 1 : 0;
+        if ((uint64_t)table->pager->num_pages + (uint64_t)(*count - i) * (cursor->depth + 2 + copies) > TABLE_MAX_PAGES) {
+            free(cursor);
+            return EXECUTE_TABLE_FULL;
+        }
+        uint32_t bound = cursor->upper_bound;
+        void* node = get_page(table->pager, cursor->page_num);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        ExecuteResult result = EXECUTE_SUCCESS;
+        do {
+            uint32_t cell_num = leaf_node_find(node, rows[i].id);
+            if (cell_num < num_cells && leaf_node_key(node, cell_num) == rows[i].id) {
+                if (!skip_existing) {
+                    result = EXECUTE_DUPLICATE_KEY;
+                    break;
+                }
+            } else {
+                if (kept != i) {
+                    rows[kept] = rows[i];
+                }
+                kept++;
+            }
+            i++;
+        } while (i < *count && rows[i].id <= bound);
+        unpin_page(table->pager, cursor->page_num);
+        free(cursor);
+        if (result != EXECUTE_SUCCESS) {
+            return result;
+        }
+    }
+    *count = kept;
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * 插入一批已经排好序、通过了table_check_batch的行：按叶子分组插入，同一个叶子里的行只下降一次，
+ * 叶子分裂之后再从根重新下降。不写wal
+ * @param table
+ * @param rows
+ * @param count
+ */
+static void table_insert_batch(Table* table, Row* rows, uint32_t count) {
+    uint32_t i = 0;
+    while (i < count && pager_error(table->pager) == EXECUTE_SUCCESS) {
+        Cursor* cursor = table_find(table, rows[i].id);
+        if (cursor == NULL) {
+            break;
+        }
+        uint32_t bound = cursor->upper_bound;
+        bool split = false;
+        do {
+            if (table->pager->copy_on_write) {
+                pager_reserve_frames(table->pager, 3 * (cursor->depth + 2));
+                cursor_copy_path(cursor);
+            } else {
+                pager_reserve_frames(table->pager, 2 * (cursor->depth + 2));
+            }
+            void* node = get_page(table->pager, cursor->page_num);
+            cursor->cell_num = leaf_node_find(node, rows[i].id);
+            split = !leaf_node_fits(node, &rows[i]);
+            unpin_page(table->pager, cursor->page_num);
+            leaf_node_insert(cursor, rows[i].id, &rows[i]);
+            i++;
+        } while (!split && i < count && rows[i].id <= bound);
+        free(cursor);
+    }
+}
+
+/**
+ * 删除叶子中从cell_num开始、key不超过high的cell，剩下的cell重新紧凑排列
+ * @param node 可以修改的叶子
+ * @param cell_num
+ * @param high
+ * @return 删除的行数
+ */
+static uint32_t leaf_node_delete(void* node, uint32_t cell_num, uint32_t high) {
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t end = cell_num;
+    while (end < num_cells && leaf_node_key(node, end) <= high) {
+        end++;
+    }
+    if (end == cell_num) {
+        return 0;
+    }
+    char old_copy[PAGE_SIZE];
+    memcpy(old_copy, node, PAGE_SIZE);
+    uint32_t count = num_cells - (end - cell_num);
+    void* cells[count + 1];
+    uint32_t keys[count + 1];
+    for (uint32_t i = 0, j = 0; i < num_cells; i++) {
+        if (i < cell_num || i >= end) {
+            cells[j] = leaf_node_cell(old_copy, i);
+            keys[j] = leaf_node_key(old_copy, i);
+            j++;
+        }
+    }
+    initialize_leaf_node(node);
+    set_node_root(node, is_node_root(old_copy));
+    leaf_node_fill(node, cells, keys, count);
+    return end - cell_num;
+}
+
+/**
+ * 一组有序的key能不能放进一个内部节点
+ * @param keys
+ * @param num_keys
+ * @return
+ */
+static bool internal_node_fits(uint32_t* keys, uint32_t num_keys) {
+    return num_keys == 0 || num_keys <= internal_node_max_keys(internal_key_width(keys[num_keys - 1] - keys[0]));
+}
+
+/**
+ * 相邻的两个叶子放得进一页时合并到左边，右边的页释放；
+ * 放不下时按字节数平分，父节点中的分隔key跟着变，父节点放不下新的key时什么都不做
+ * @param pager
+ * @param children 父节点的孩子，已经可以修改
+ * @param keys 父节点的key，重新分配时更新分隔key
+ * @param num_keys
+ * @param left_index 左边的孩子序号
+ * @return 是否合并了
+ */
+static bool leaf_node_rebalance(Pager* pager, uint32_t* children, uint32_t* keys, uint32_t num_keys, uint32_t left_index) {
+    uint32_t left_page_num = children[left_index];
+    uint32_t right_page_num = children[left_index + 1];
+    void* left = get_page_for_write(pager, left_page_num);
+    void* right = get_page_for_write(pager, right_page_num);
+    char left_copy[PAGE_SIZE];
+    char right_copy[PAGE_SIZE];
+    memcpy(left_copy, left, PAGE_SIZE);
+    memcpy(right_copy, right, PAGE_SIZE);
+
+    uint32_t left_cells = *leaf_node_num_cells(left_copy);
+    uint32_t num_cells = left_cells + *leaf_node_num_cells(right_copy);
+    void* cells[num_cells + 1];
+    uint32_t cell_keys[num_cells + 1];
+    uint32_t sizes[num_cells + 1];
+    uint32_t total_size = 0;
+    for (uint32_t i = 0; i < num_cells; i++) {
+        void* node = i < left_cells ? left_copy : right_copy;
+        uint32_t cell_num = i < left_cells ? i : i - left_cells;
+        cells[i] = leaf_node_cell(node, cell_num);
+        cell_keys[i] = leaf_node_key(node, cell_num);
+        uint32_t delta;
+        sizes[i] = leaf_cell_size(cells[i]) - varint_decode(cells[i], &delta) +
+                varint_size(cell_keys[i] - cell_keys[0]) + LEAF_NODE_SLOT_SIZE;
+        total_size += sizes[i];
+    }
+
+    if (total_size <= LEAF_NODE_SPACE_FOR_CELLS) {
+        initialize_leaf_node(left);
+        leaf_node_fill(left, cells, cell_keys, num_cells);
+        unpin_page(pager, left_page_num);
+        unpin_page(pager, right_page_num);
+        pager_free_page(pager, right_page_num);
+        return true;
+    }
+
+    // 和分裂一样左边装到一半字节数为止
+    uint32_t left_count = 0;
+    uint32_t left_size = 0;
+    while (left_count < num_cells - 1 && (left_count == 0 || left_size < total_size / 2)) {
+        left_size += sizes[left_count];
+        left_count++;
+    }
+    uint32_t old_separator = keys[left_index];
+    keys[left_index] = cell_keys[left_count - 1];
+    if (!internal_node_fits(keys, num_keys)) {
+        keys[left_index] = old_separator;
+    } else {
+        initialize_leaf_node(left);
+        initialize_leaf_node(right);
+        leaf_node_fill(left, cells, cell_keys, left_count);
+        leaf_node_fill(right, cells + left_count, cell_keys + left_count, num_cells - left_count);
+    }
+    unpin_page(pager, left_page_num);
+    unpin_page(pager, right_page_num);
+    return false;
+}
+
+/**
+ * 相邻的两个内部节点连同父节点中的分隔key放得进一页时合并到左边，右边的页释放；
+ * 放不下时对半分，中间的key上移到父节点，父节点放不下新的key时什么都不做
+ * @param pager
+ * @param children 父节点的孩子，已经可以修改
+ * @param keys 父节点的key，重新分配时更新分隔key
+ * @param num_keys
+ * @param left_index 左边的孩子序号
+ * @return 是否合并了
+ */
+static bool internal_node_rebalance(Pager* pager, uint32_t* children, uint32_t* keys, uint32_t num_keys, uint32_t left_index) {
+    uint32_t left_page_num = children[left_index];
+    uint32_t right_page_num = children[left_index + 1];
+    void* left = get_page_for_write(pager, left_page_num);
+    void* right = get_page_for_write(pager, right_page_num);
+
+    // 左节点的key、父节点中的分隔key、右节点的key依次排起来
+    uint32_t merged_children[2 * INTERNAL_NODE_MAX_CELLS + 2];
+    uint32_t merged_keys[2 * INTERNAL_NODE_MAX_CELLS + 1];
+    uint32_t left_keys = internal_node_unpack(left, merged_children, merged_keys);
+    merged_keys[left_keys] = keys[left_index];
+    uint32_t right_keys = internal_node_unpack(right, merged_children + left_keys + 1, merged_keys + left_keys + 1);
+    uint32_t total_keys = left_keys + 1 + right_keys;
+
+    bool merged = internal_node_fits(merged_keys, total_keys);
+    if (merged) {
+        internal_node_fill(left, merged_children, merged_keys, total_keys);
+    } else {
+        uint32_t split_index = total_keys / 2;
+        uint32_t old_separator = keys[left_index];
+        keys[left_index] = merged_keys[split_index];
+        if (!internal_node_fits(merged_keys, split_index) ||
+            !internal_node_fits(merged_keys + split_index + 1, total_keys - split_index - 1) ||
+            !internal_node_fits(keys, num_keys)) {
+            keys[left_index] = old_separator;
+        } else {
+            internal_node_fill(left, merged_children, merged_keys, split_index);
+            internal_node_fill(right, merged_children + split_index + 1, merged_keys + split_index + 1,
+                               total_keys - split_index - 1);
+        }
+    }
+    unpin_page(pager, left_page_num);
+    unpin_page(pager, right_page_num);
+    if (merged) {
+        pager_free_page(pager, right_page_num);
+    }
+    return merged;
+}
+
+/**
+ * 根节点是只剩一个孩子的内部节点时，把孩子的内容搬进根页并释放孩子，树变矮一层。
+ * 根页的编号不变，meta页和快照都不用改
+ * @param pager
+ */
+static void btree_shrink_root(Pager* pager) {
+    uint32_t root_page_num = pager->root_page_num;
+    void* root = get_page(pager, root_page_num);
+    while (get_node_type(root) == NODE_INTERNAL && *internal_node_num_keys(root) == 0) {
+        uint32_t child_page_num = *internal_node_right_child(root);
+        unpin_page(pager, root_page_num);
+        void* child = get_page(pager, child_page_num);
+        root = get_page_for_write(pager, root_page_num);
+        memcpy(root, child, PAGE_SIZE);
+        set_node_root(root, true);
+        unpin_page(pager, child_page_num);
+        pager_free_page(pager, child_page_num);
+    }
+    unpin_page(pager, root_page_num);
+}
+
+/**
+ * 删除之后，cursor路径上第level层的节点(level等于depth时是叶子)太空时和相邻的兄弟合并，
+ * 合不进一页就在两个节点之间重新分配。合并让父节点少了一个孩子，父节点太空时继续向上处理，
+ * 到根时收缩只剩一个孩子的根
+ * @param cursor 记录了下降路径的cursor，路径上的页都可以原地修改
+ * @param level
+ */
+static void btree_rebalance(Cursor* cursor, uint32_t level) {
+    Pager* pager = cursor->table->pager;
+    if (pager_error(pager) != EXECUTE_SUCCESS) {
+        // 读到的页可能不对，语句的修改反正要丢掉
+        return;
+    }
+    if (level == 0) {
+        btree_shrink_root(pager);
+        return;
+    }
+    uint32_t page_num = level == cursor->depth ? cursor->page_num : cursor->path[level].page_num;
+    void* node = get_page(pager, page_num);
+    bool leaf = get_node_type(node) == NODE_LEAF;
+    bool underfull = leaf ? LEAF_NODE_SPACE_FOR_CELLS - leaf_node_free_space(node) < LEAF_NODE_MIN_USED :
+            *internal_node_num_keys(node) < INTERNAL_NODE_MIN_KEYS;
+    unpin_page(pager, page_num);
+    if (!underfull) {
+        return;
+    }
+
+    PathEntry* entry = &(cursor->path[level - 1]);
+    void* parent = get_page_for_write(pager, entry->page_num);
+    uint32_t children[INTERNAL_NODE_MAX_CELLS + 1];
+    uint32_t keys[INTERNAL_NODE_MAX_CELLS];
+    uint32_t num_keys = internal_node_unpack(parent, children, keys);
+    if (num_keys == 0) {
+        // 没有兄弟，只可能是正在收缩的根
+        unpin_page(pager, entry->page_num);
+        return;
+    }
+    // 和右边的兄弟一起处理，最右边的孩子和左边的兄弟一起
+    uint32_t left_index = entry->child_index < num_keys ? entry->child_index : num_keys - 1;
+    // 写时复制模式下兄弟节点也要先复制
+    children[left_index] = pager_copy_page(pager, children[left_index]);
+    children[left_index + 1] = pager_copy_page(pager, children[left_index + 1]);
+    bool merged = leaf ? leaf_node_rebalance(pager, children, keys, num_keys, left_index) :
+            internal_node_rebalance(pager, children, keys, num_keys, left_index);
+    if (merged) {
+        // 右边的孩子并进了左边，去掉它和它们之间的分隔key
+        memmove(children + left_index + 1, children + left_index + 2, sizeof(uint32_t) * (num_keys - left_index - 1));
+        memmove(keys + left_index, keys + left_index + 1, sizeof(uint32_t) * (num_keys - left_index - 1));
+        num_keys--;
+    }
+    internal_node_fill(parent, children, keys, num_keys);
+    unpin_page(pager, entry->page_num);
+    if (merged) {
+        btree_rebalance(cursor, level - 1);
+    }
+}
+
+/**
+ * 删除id在[low, high]范围内的行：逐个叶子删除，每个叶子删完之后向上合并。不写wal
+ * @param table
+ * @param low
+ * @param high
+ * @return 删除的行数
+ */
+static uint32_t table_delete(Table* table, uint32_t low, uint32_t high) {
+    Pager* pager = table->pager;
+    uint32_t deleted = 0;
+    uint32_t key = low;
+    while (key <= high && pager_error(pager) == EXECUTE_SUCCESS) {
+        Cursor* cursor = table_find(table, key);
+        if (cursor == NULL) {
+            break;
+        }
+        uint32_t bound = cursor->upper_bound;
+        void* node = get_page(pager, cursor->page_num);
+        bool found = cursor->cell_num < *leaf_node_num_cells(node) && leaf_node_key(node, cursor->cell_num) <= high;
+        unpin_page(pager, cursor->page_num);
+        if (found) {
+            // 路径上每一层最坏都要改父节点和两个孩子；写时复制模式下路径上每一页还要复制
+            uint32_t copies = pager->copy_on_write ? 2 * (cursor->depth + 1) : 0;
+            pager_reserve_frames(pager, 3 * (cursor->depth + 1) + copies);
+            if (pager->copy_on_write) {
+                cursor_copy_path(cursor);
+            }
+            node = get_page_for_write(pager, cursor->page_num);
+            deleted += leaf_node_delete(node, cursor->cell_num, high);
+            unpin_page(pager, cursor->page_num);
+            btree_rebalance(cursor, cursor->depth);
+        }
+        free(cursor);
+        if (bound >= high) {
+            break;
+        }
+        // 合并之后叶子的边界可能变了，从下一个key重新下降
+        key = bound + 1;
+    }
+    return deleted;
+}
+
+/**
+ * 插入记录最长的字节数
+ */
+static const uint32_t WAL_INSERT_MAX_SIZE = sizeof(uint32_t) + 2 + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE;
+
+/**
+ * 把行编码成插入记录：id(4字节) + username长度(1字节) + username + email长度(1字节) + email
+ * @param row
+ * @param payload 至少WAL_INSERT_MAX_SIZE个字节
+ * @return 记录长度
+ */
+static uint32_t wal_encode_insert(Row* row, char* payload) {
+    uint32_t length = 0;
+    uint8_t username_length = strlen(row->username);
+    uint8_t email_length = strlen(row->email);
+    memcpy(payload + length, &(row->id), sizeof(uint32_t));
+    length += sizeof(uint32_t);
+    payload[length++] = username_length;
+    memcpy(payload + length, row->username, username_length);
+    length += username_length;
+    payload[length++] = email_length;
+    memcpy(payload + length, row->email, email_length);
+    length += email_length;
+    return length;
+}
+
+/**
+ * 把插入写进wal：key + 长度前缀的username、email，只记录实际长度
+ * @param wal
+ * @param row
+ */
+static void wal_log_insert(Wal* wal, Row* row) {
+    char payload[WAL_INSERT_MAX_SIZE];
+    uint32_t length = wal_encode_insert(row, payload);
+    wal_append(wal, WAL_RECORD_INSERT, payload, length);
+}
+
+/**
+ * 解析wal中的插入记录
+ * @param payload
+ * @param row
+ */
+static void wal_decode_insert(char* payload, Row* row) {
+    uint32_t offset = 0;
+    memcpy(&(row->id), payload, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    uint8_t username_length = payload[offset++];
+    memcpy(row->username, payload + offset, username_length);
+    row->username[username_length] = '\0';
+    offset += username_length;
+    uint8_t email_length = payload[offset++];
+    memcpy(row->email, payload + offset, email_length);
+    row->email[email_length] = '\0';
+}
+
+/**
+ * 把删除写进wal：要删除的id范围key_low、key_high
+ * @param wal
+ * @param low
+ * @param high
+ */
+static void wal_log_delete(Wal* wal, uint32_t low, uint32_t high) {
+    uint32_t payload[2] = {low, high};
+    wal_append(wal, WAL_RECORD_DELETE, payload, sizeof(payload));
+}
+
+static uint32_t table_delete(Table* table, uint32_t low, uint32_t high);
+
+/**
+ * 崩溃恢复的第二步：按顺序重放wal中的插入和删除记录。
+ * 页镜像恢复后数据库文件包含了其中一部分修改，已经存在的key直接跳过，已经删掉的范围再删一次也没有影响，
+ * 所以可以从头重放
+ * @param table
+ */
+static void wal_replay(Table* table) {
+    Wal* wal = table->pager->wal;
+    uint64_t end = wal->file_length;
+    if (end == 0) {
+        return;
+    }
+    // 重放中途可能触发checkpoint，这时不能清空还没重放完的wal
+    wal->keep_records = true;
+    uint64_t offset = 0;
+    WalRecordType type;
+    void* payload;
+    uint32_t length;
+    Row row;
+    while (offset < end && pager_error(table->pager) == EXECUTE_SUCCESS) {
+        offset = wal_read_record(wal, offset, &type, &payload, &length);
+        if (type == WAL_RECORD_INSERT) {
+            wal_decode_insert(payload, &row);
+            table_insert(table, &row);
+        } else if (type == WAL_RECORD_DELETE) {
+            uint32_t* range = payload;
+            table_delete(table, range[0], range[1]);
+        }
+        free(payload);
+    }
+    wal->keep_records = false;
+    // 重放的结果写回数据库文件，清空wal
+    pager_checkpoint(table->pager);
+}
+
+/**
+ * 插入一批行：按id排序，先整体检查，有任何一行不能插入时一行都不插入。
+ * wal记录先于修改写进缓冲区，应用过程中的checkpoint不清空wal，
+ * 所以崩溃之后要么整批都能重放出来，要么整批都没有持久化；整批只提交一次，
+ * 修改的页多到缓冲池装不下时读会先看到其中一部分(见pager_limit_pending)
+ * @param table
+ * @param rows 会被原地排序
+ * @param count 输入行数，skip_existing为true时输出实际插入的行数
+ * @param skip_existing 跳过表里已经有的id，而不是整批都不插入
+ * @return
+ */
+static ExecuteResult execute_insert_batch(Table* table, Row* rows, uint32_t* count, bool skip_existing) {
+    qsort(rows, *count, sizeof(Row), compare_row_id);
+    ExecuteResult result = table_check_batch(table, rows, count, skip_existing);
+    if (result != EXECUTE_SUCCESS || *count == 0) {
+        return result;
+    }
+    Wal* wal = table->pager->wal;
+    if (wal == NULL) {
+        table_insert_batch(table, rows, *count);
+        return EXECUTE_SUCCESS;
+    }
+    for (uint32_t i = 0; i < *count; i++) {
+        wal_log_insert(wal, &rows[i]);
+    }
+    wal->keep_records = true;
+    table_insert_batch(table, rows, *count);
+    wal->keep_records = false;
+    if (!wal_commit(wal, &(table->pager->stats))) {
+        pager_fail(table->pager, EXECUTE_IO_ERROR);
+    }
+    if (wal->file_length + wal->buffer_length > WAL_CHECKPOINT_SIZE) {
+        pager_checkpoint(table->pager);
+    }
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * 把行加入当前事务，commit时才插入
+ * @param table
+ * @param rows
+ * @param count
+ */
+static void transaction_add(Table* table, Row* rows, uint32_t count) {
+    if (table->batch_length + count > table->batch_capacity) {
+        while (table->batch_length + count > table->batch_capacity) {
+            table->batch_capacity = table->batch_capacity == 0 ? 64 : table->batch_capacity * 2;
+        }
+        table->batch = realloc(table->batch, sizeof(Row) * table->batch_capacity);
+    }
+    memcpy(table->batch + table->batch_length, rows, sizeof(Row) * count);
+    table->batch_length += count;
+}
+
+/**
+ * 执行事务语句：begin开始攒插入，commit把攒下的插入作为一批应用，rollback丢弃
+ * @param statement
+ * @param table
+ * @return
+ */
+static ExecuteResult execute_transaction(Statement* statement, Table* table) {
+    if (statement->type == STATEMENT_BEGIN) {
+        if (table->in_transaction) {
+            return EXECUTE_NESTED_TRANSACTION;
+        }
+        table->in_transaction = true;
+        return EXECUTE_SUCCESS;
+    }
+    if (!table->in_transaction) {
+        return EXECUTE_NO_TRANSACTION;
+    }
+    ExecuteResult result = EXECUTE_SUCCESS;
+    if (statement->type == STATEMENT_COMMIT && table->batch_length > 0) {
+        result = execute_insert_batch(table, table->batch, &(table->batch_length), false);
+    }
+    // commit失败时整个事务回滚
+    table->in_transaction = false;
+    table->batch_length = 0;
+    return result;
+}
+
+static ExecuteResult execute_insert(Statement* statement, Table* table) {
+    Row* rows = statement->rows != NULL ? statement->rows : &(statement->row_to_insert);
+    uint32_t count = statement->rows != NULL ? statement->num_rows : 1;
+    if (table->in_transaction) {
+        // 事务中的插入在commit时才应用
+        transaction_add(table, rows, count);
+        return EXECUTE_SUCCESS;
+    }
+    if (statement->rows != NULL) {
+        return execute_insert_batch(table, rows, &count, false);
+    }
+    ExecuteResult result = table_insert(table, &(statement->row_to_insert));
+    Wal* wal = table->pager->wal;
+    if (result == EXECUTE_SUCCESS && wal != NULL) {
+        wal_log_insert(wal, &(statement->row_to_insert));
+        if (!wal_commit(wal, &(table->pager->stats))) {
+            pager_fail(table->pager, EXECUTE_IO_ERROR);
+        }
+        if (wal->file_length + wal->buffer_length > WAL_CHECKPOINT_SIZE) {
+            pager_checkpoint(table->pager);
+        }
+    }
+    return result;
+}
+
+/**
+ * 执行delete语句。事务只攒插入，事务中不能delete。
+ * 和插入一批行一样，wal记录先于修改写进缓冲区，删除过程中的checkpoint不清空wal，
+ * 崩溃之后要么整个范围都能重放出来，要么一行都没有删；范围很大时读可能先看到删了一部分
+ * @param statement
+ * @param table
+ * @return
+ */
+static ExecuteResult execute_delete(Statement* statement, Table* table) {
+    if (table->in_transaction) {
+        return EXECUTE_DELETE_IN_TRANSACTION;
+    }
+    Wal* wal = table->pager->wal;
+    if (wal == NULL) {
+        table_delete(table, statement->key_low, statement->key_high);
+        return EXECUTE_SUCCESS;
+    }
+    wal_log_delete(wal, statement->key_low, statement->key_high);
+    wal->keep_records = true;
+    table_delete(table, statement->key_low, statement->key_high);
+    wal->keep_records = false;
+    if (!wal_commit(wal, &(table->pager->stats))) {
+        pager_fail(table->pager, EXECUTE_IO_ERROR);
+    }
+    if (wal->file_length + wal->buffer_length > WAL_CHECKPOINT_SIZE) {
+        pager_checkpoint(table->pager);
+    }
+    return EXECUTE_SUCCESS;
+}
+
+static ExecuteResult execute_select(Statement* statement, Table* table) {
+    if (pager_error(table->pager) != EXECUTE_SUCCESS) {
+        return pager_error(table->pager);
+    }
+    // 直接定位到范围内的第一行，超出范围后立即停止
+    // 范围扫描时预读后面的叶子
+    Cursor* cursor = table_seek(table, statement->key_low, statement->key_high > statement->key_low);
+//    for (uint32_t i = 0; i < table->num_rows; i++) {
+//        // 把内存中的行读取到row
+//        deserialize_row(row_slot(table, i), &row);
+//        // 打印row
+//        print_row(&row);
+//    }
+    // 直接从页里读字段格式化到输出缓冲区，不拷贝到Row
+    RowView view;
+    while (!(cursor->end_of_table)) {
+        cursor_row_view(cursor, statement->columns, &view);
+        if (view.id > statement->key_high) {
+            break;
+        }
+        result_sink_write_row(table->sink, &view, statement->projection, statement->projection_count);
+        cursor_advance(cursor);
+    }
+
+    result_sink_flush(table->sink);
+    cursor_close(cursor);
+    // 读失败时已经输出的结果可能不完整
+    return pager_error(table->pager);
+}
+
+/**
+ * 执行sql语句
+ * @param statement 待执行的语句
+ * @param table 当前表
+ * @return 执行结果
+ */
+static ExecuteResult execute_statement(Statement* statement, Table* table) {
+    if (statement->num_params > 0) {
+        return EXECUTE_UNBOUND_PARAMETER;
+    }
+    if (statement->type == STATEMENT_SELECT) {
+        // 读不拿写锁，在快照中读，不会和修改b树的线程互相等待
+        return execute_select(statement, table);
+    }
+    ExecuteResult result = pager_error(table->pager);
+    if (result != EXECUTE_SUCCESS) {
+        // 出过错的表只能关闭
+        return result;
+    }
+    pthread_mutex_lock(&(table->write_lock));
+    // 分情况处理各种语句
+    switch (statement->type) {
+        case(STATEMENT_INSERT):
+            result = execute_insert(statement, table);
+            break;
+        case(STATEMENT_SELECT):
+            break;
+        case(STATEMENT_BEGIN):
+        case(STATEMENT_COMMIT):
+        case(STATEMENT_ROLLBACK):
+            result = execute_transaction(statement, table);
+            break;
+        case(STATEMENT_DELETE):
+            result = execute_delete(statement, table);
+            break;
+    }
+    // 语句的修改一起对读可见，出错时丢弃
+    pager_commit(table->pager);
+    pthread_mutex_unlock(&(table->write_lock));
+    if (pager_error(table->pager) != EXECUTE_SUCCESS) {
+        result = pager_error(table->pager);
+    }
+    return result;
+}
+
+/**
+ * 预编译语句：解析一次，之后每次只绑定参数再执行
+ */
+struct PreparedStatement {
+    Table* table;
+    Statement statement; // 解析结果，占位符处是默认值
+    bool* bound; // 每个占位符是否已经绑定
+    Statement scratch; // 执行时使用的副本，多行insert执行时会排序，不能改动statement
+    Cursor* cursor; // db_step逐行读取select结果时的光标，NULL表示没有在读取
+    RowView view; // 当前行，光标所在的页在下一次db_step之前一直被pin住
+};
+
+/**
+ * 解析语句，语句中可以用'?'代替insert的字段和where中的id
+ * @param table
+ * @param sql
+ * @param result 解析结果
+ * @return 解析失败时返回NULL
+ */
+PreparedStatement* db_prepare(Table* table, const char* sql, PrepareResult* result) {
+    char* buffer = strdup(sql);
+    PreparedStatement* prepared = malloc(sizeof(PreparedStatement));
+    *result = prepare_statement(buffer, &(prepared->statement));
+    free(buffer);
+    if (*result != PREPARE_SUCCESS) {
+        free(prepared);
+        return NULL;
+    }
+    prepared->table = table;
+    prepared->cursor = NULL;
+    prepared->bound = calloc(prepared->statement.num_params + 1, sizeof(bool));
+    prepared->scratch = prepared->statement;
+    prepared->scratch.params = NULL;
+    prepared->scratch.num_params = 0;
+    if (prepared->statement.rows != NULL) {
+        prepared->scratch.rows = malloc(sizeof(Row) * prepared->statement.num_rows);
+    }
+    return prepared;
+}
+
+/**
+ * 找到占位符对应的insert行
+ * @param prepared
+ * @param slot
+ * @return
+ */
+static Row* prepared_param_row(PreparedStatement* prepared, ParamSlot* slot) {
+    Statement* statement = &(prepared->statement);
+    return statement->rows != NULL ? &(statement->rows[slot->row]) : &(statement->row_to_insert);
+}
+
+/**
+ * 给整数占位符绑定值
+ * @param prepared
+ * @param index 第几个占位符，从1开始
+ * @param value
+ * @return
+ */
+BindResult db_bind_int(PreparedStatement* prepared, uint32_t index, uint32_t value) {
+    Statement* statement = &(prepared->statement);
+    if (index == 0 || index > statement->num_params) {
+        return BIND_INDEX_OUT_OF_RANGE;
+    }
+    ParamSlot* slot = &(statement->params[index - 1]);
+    switch (slot->target) {
+        case PARAM_ID:
+            prepared_param_row(prepared, slot)->id = value;
+            break;
+        case PARAM_KEY:
+            statement->key_low = value;
+            statement->key_high = value;
+            break;
+        case PARAM_KEY_LOW:
+            statement->key_low = value;
+            break;
+        case PARAM_KEY_HIGH:
+            statement->key_high = value;
+            break;
+        default:
+            return BIND_TYPE_MISMATCH;
+    }
+    prepared->bound[index - 1] = true;
+    return BIND_SUCCESS;
+}
+
+/**
+ * 给字符串占位符绑定值
+ * @param prepared
+ * @param index 第几个占位符，从1开始
+ * @param value
+ * @return
+ */
+BindResult db_bind_text(PreparedStatement* prepared, uint32_t index, const char* value) {
+    Statement* statement = &(prepared->statement);
+    if (index == 0 || index > statement->num_params) {
+        return BIND_INDEX_OUT_OF_RANGE;
+    }
+    ParamSlot* slot = &(statement->params[index - 1]);
+    Row* row = prepared_param_row(prepared, slot);
+    size_t length = strlen(value);
+    switch (slot->target) {
+        case PARAM_USERNAME:
+            if (length > COLUMN_USERNAME_SIZE) {
+                return BIND_STRING_TOO_LONG;
+            }
+            memcpy(row->username, value, length + 1);
+            break;
+        case PARAM_EMAIL:
+            if (length > COLUMN_EMAIL_SIZE) {
+                return BIND_STRING_TOO_LONG;
+            }
+            memcpy(row->email, value, length + 1);
+            break;
+        default:
+            return BIND_TYPE_MISMATCH;
+    }
+    prepared->bound[index - 1] = true;
+    return BIND_SUCCESS;
+}
+
+/**
+ * 清除所有绑定，之后要重新绑定所有占位符才能执行
+ * @param prepared
+ */
+void db_clear_bindings(PreparedStatement* prepared) {
+    memset(prepared->bound, 0, sizeof(bool) * prepared->statement.num_params);
+}
+
+/**
+ * 检查所有占位符都绑定了，把绑定的参数拷贝到执行用的副本
+ * @param prepared
+ * @return 有占位符没有绑定时返回NULL
+ */
+static Statement* prepared_bind_scratch(PreparedStatement* prepared) {
+    Statement* statement = &(prepared->statement);
+    for (uint32_t i = 0; i < statement->num_params; i++) {
+        if (!prepared->bound[i]) {
+            return NULL;
+        }
+    }
+    // 只拷贝执行时需要的部分，不重新解析
+    Statement* scratch = &(prepared->scratch);
+    scratch->row_to_insert = statement->row_to_insert;
+    scratch->key_low = statement->key_low;
+    scratch->key_high = statement->key_high;
+    if (statement->rows != NULL) {
+        memcpy(scratch->rows, statement->rows, sizeof(Row) * statement->num_rows);
+    }
+    return scratch;
+}
+
+/**
+ * 用当前绑定的参数执行语句，绑定保持不变，可以只改一部分参数再执行
+ * @param prepared
+ * @return
+ */
+ExecuteResult db_execute(PreparedStatement* prepared) {
+    db_reset(prepared);
+    Statement* scratch = prepared_bind_scratch(prepared);
+    if (scratch == NULL) {
+        return EXECUTE_UNBOUND_PARAMETER;
+    }
+    return execute_statement(scratch, prepared->table);
+}
+
+/**
+ * 逐行执行语句：select每次返回一行，不写到输出，其他语句一次执行完
+ * 返回EXECUTE_ROW时可以用db_column_*读取这一行，字段直接指向页内，下一次db_step或db_reset之后失效；
+ * 读完之后返回EXECUTE_SUCCESS，再调用会从头开始。
+ * 第一次db_step时开始一个快照，直到读完或db_reset都只看到那时已经提交的行，
+ * 读取过程中这张表可以被任何线程(包括自己)修改，读和写互不等待
+ * @param prepared
+ * @return
+ */
+ExecuteResult db_step(PreparedStatement* prepared) {
+    Statement* scratch = &(prepared->scratch);
+    if (scratch->type != STATEMENT_SELECT) {
+        return db_execute(prepared);
+    }
+    Cursor* cursor = prepared->cursor;
+    if (cursor == NULL) {
+        if (pager_error(prepared->table->pager) != EXECUTE_SUCCESS) {
+            return pager_error(prepared->table->pager);
+        }
+        if (prepared_bind_scratch(prepared) == NULL) {
+            return EXECUTE_UNBOUND_PARAMETER;
+        }
+        // 和execute_select一样直接定位到范围内的第一行
+        cursor = table_seek(prepared->table, scratch->key_low, scratch->key_high > scratch->key_low);
+        prepared->cursor = cursor;
+    } else {
+        cursor_advance(cursor);
+    }
+
+    // 读失败时不再返回行
+    ExecuteResult error = pager_error(prepared->table->pager);
+    if (!(cursor->end_of_table) && error == EXECUTE_SUCCESS) {
+        cursor_row_view(cursor, scratch->columns, &(prepared->view));
+        if (prepared->view.id <= scratch->key_high) {
+            return EXECUTE_ROW;
+        }
+    }
+    cursor_close(cursor);
+    prepared->cursor = NULL;
+    return error;
+}
+
+/**
+ * 当前行有几列
+ * @param prepared
+ * @return
+ */
+uint32_t db_column_count(PreparedStatement* prepared) {
+    return prepared->statement.projection_count;
+}
+
+/**
+ * 读取当前行的整数列
+ * @param prepared
+ * @param column 第几列，从0开始，按select中列出的顺序
+ * @return 不是整数列时返回0
+ */
+uint32_t db_column_int(PreparedStatement* prepared, uint32_t column) {
+    if (prepared->cursor == NULL || column >= prepared->statement.projection_count ||
+        prepared->statement.projection[column] != COLUMN_ID) {
+        return 0;
+    }
+    return prepared->view.id;
+}
+
+/**
+ * 读取当前行的字符串列，字符串不以'\0'结尾
+ * @param prepared
+ * @param column 第几列，从0开始，按select中列出的顺序
+ * @param length 字符串长度
+ * @return 不是字符串列时返回NULL
+ */
+const char* db_column_text(PreparedStatement* prepared, uint32_t column, uint32_t* length) {
+    *length = 0;
+    if (prepared->cursor == NULL || column >= prepared->statement.projection_count) {
+        return NULL;
+    }
+    switch (prepared->statement.projection[column]) {
+        case COLUMN_USERNAME:
+            *length = prepared->view.username_length;
+            return prepared->view.username;
+        case COLUMN_EMAIL:
+            *length = prepared->view.email_length;
+            return prepared->view.email;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * 结束还没读完的select，释放光标，绑定保持不变
+ * @param prepared
+ */
+void db_reset(PreparedStatement* prepared) {
+    if (prepared->cursor != NULL) {
+        cursor_close(prepared->cursor);
+        prepared->cursor = NULL;
+    }
+}
+
+/**
+ * 释放预编译语句
+ * @param prepared
+ */
+void db_finalize(PreparedStatement* prepared) {
+    db_reset(prepared);
+    free(prepared->scratch.rows);
+    statement_free(&(prepared->statement));
+    free(prepared->bound);
+    free(prepared);
+}
+
+/**
+ * 解析csv中的一个字段，支持用引号括起来、引号写两遍的字段(和.mode csv的输出一致)
+ * @param cursor 当前读到的位置，解析完指向字段之后
+ * @param field 字段内容，以'\0'结尾
+ * @param max_length 字段最大长度
+ * @return 解析结果
+ */
+static PrepareResult csv_parse_field(char** cursor, char* field, uint32_t max_length) {
+    char* in = *cursor;
+    uint32_t length = 0;
+    if (*in == '"') {
+        in++;
+        while (true) {
+            if (*in == '\0') {
+                // 引号没有闭合
+                return PREPARE_SYNTAX_ERROR;
+            }
+            if (*in == '"') {
+                if (in[1] != '"') {
+                    in++;
+                    break;
+                }
+                in++;
+            }
+            if (length == max_length) {
+                return PREPARE_STRING_TOO_LONG;
+            }
+            field[length++] = *in++;
+        }
+        if (*in != ',' && *in != '\0') {
+            return PREPARE_SYNTAX_ERROR;
+        }
+    } else {
+        while (*in != ',' && *in != '\0') {
+            if (length == max_length) {
+                return PREPARE_STRING_TOO_LONG;
+            }
+            field[length++] = *in++;
+        }
+    }
+    field[length] = '\0';
+    *cursor = in;
+    return PREPARE_SUCCESS;
+}
+
+/**
+ * 解析csv的一行：id,username,email
+ * @param line 去掉换行符的一行
+ * @param row
+ * @return 解析结果
+ */
+static PrepareResult csv_parse_row(char* line, Row* row) {
+    char id_string[16];
+    PrepareResult result = csv_parse_field(&line, id_string, sizeof(id_string) - 1);
+    if (result != PREPARE_SUCCESS) {
+        return result == PREPARE_STRING_TOO_LONG ? PREPARE_SYNTAX_ERROR : result;
+    }
+    if (*line++ != ',') {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    result = csv_parse_field(&line, row->username, COLUMN_USERNAME_SIZE);
+    if (result != PREPARE_SUCCESS) {
+        return result;
+    }
+    if (*line++ != ',') {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    result = csv_parse_field(&line, row->email, COLUMN_EMAIL_SIZE);
+    if (result != PREPARE_SUCCESS) {
+        return result;
+    }
+    if (*line != '\0') {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    char* end;
+    long long id = strtoll(id_string, &end, 10);
+    if (end == id_string || *end != '\0') {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (id < 0) {
+        return PREPARE_NEGATIVE_ID;
+    }
+    if (id > UINT32_MAX) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    row->id = (uint32_t)id;
+    return PREPARE_SUCCESS;
+}
+
+/**
+ * 内存中的一条待导入记录，按(key, offset)排序，重复的id保留文件中先出现的那条
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t offset; // 记录在run缓冲区中的偏移，记录格式和wal插入记录相同
+} ImportEntry;
+
+/**
+ * 写到临时文件里的一个有序run
+ */
+typedef struct {
+    FILE* file;
+    Row row; // run中当前最小的一行
+    bool done;
+} ImportRun;
+
+/**
+ * 按key有序地产生待导入的行：数据都在内存中时直接遍历排好序的entries，否则对多个run做归并
+ */
+typedef struct {
+    char* buffer; // run缓冲区
+    uint32_t buffer_length;
+    ImportEntry* entries;
+    uint32_t num_entries;
+    uint32_t entries_capacity;
+    uint32_t next_entry;
+    ImportRun* runs;
+    uint32_t num_runs;
+} ImportSource;
+
+static int compare_import_entry(const void* a, const void* b) {
+    const ImportEntry* left = a;
+    const ImportEntry* right = b;
+    if (left->key != right->key) {
+        return left->key < right->key ? -1 : 1;
+    }
+    return left->offset < right->offset ? -1 : (left->offset > right->offset);
+}
+
+/**
+ * 从run文件中读一行
+ * @param file
+ * @param row
+ * @return 读到文件末尾时返回false
+ */
+static bool import_read_row(FILE* file, Row* row) {
+    uint8_t length;
+    if (fread(&(row->id), sizeof(uint32_t), 1, file) != 1 || fread(&length, 1, 1, file) != 1 ||
+        fread(row->username, 1, length, file) != length) {
+        return false;
+    }
+    row->username[length] = '\0';
+    if (fread(&length, 1, 1, file) != 1 || fread(row->email, 1, length, file) != length) {
+        return false;
+    }
+    row->email[length] = '\0';
+    return true;
+}
+
+/**
+ * 把内存中的记录排序后写成一个run，然后清空缓冲区
+ * @param source
+ * @return 创建或者写临时文件失败时返回false
+ */
+static bool import_spill_run(ImportSource* source) {
+    qsort(source->entries, source->num_entries, sizeof(ImportEntry), compare_import_entry);
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < source->num_entries; i++) {
+        char* record = source->buffer + source->entries[i].offset;
+        uint32_t username_length = (uint8_t)record[sizeof(uint32_t)];
+        uint32_t email_length = (uint8_t)record[sizeof(uint32_t) + 1 + username_length];
+        fwrite(record, 1, sizeof(uint32_t) + 2 + username_length + email_length, file);
+    }
+    if (fflush(file) != 0) {
+        fclose(file);
+        return false;
+    }
+    rewind(file);
+    source->runs = realloc(source->runs, sizeof(ImportRun) * (source->num_runs + 1));
+    ImportRun* run = &(source->runs[source->num_runs++]);
+    run->file = file;
+    run->done = !import_read_row(file, &(run->row));
+    source->num_entries = 0;
+    source->buffer_length = 0;
+    return true;
+}
+
+/**
+ * 读入csv文件，在内存中排序，超出IMPORT_RUN_SIZE的部分分成多个有序run写到临时文件
+ * @param source
+ * @param file
+ * @param import 有不能解析的行时输出行号和原因
+ * @return
+ */
+static ExecuteResult import_source_open(ImportSource* source, FILE* file, ImportResult* import) {
+    memset(source, 0, sizeof(ImportSource));
+    source->buffer = malloc(IMPORT_RUN_SIZE);
+    bool sorted = true;
+    uint32_t last_key = 0;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_length;
+    uint32_t line_num = 0;
+    while ((line_length = getline(&line, &line_capacity, file)) != -1) {
+        line_num++;
+        while (line_length > 0 && (line[line_length - 1] == '\n' || line[line_length - 1] == '\r')) {
+            line[--line_length] = '\0';
+        }
+        if (line_length == 0) {
+            continue;
+        }
+        Row row;
+        PrepareResult result = csv_parse_row(line, &row);
+        if (result != PREPARE_SUCCESS) {
+            free(line);
+            import->error_line = line_num;
+            import->line_error = result;
+            return EXECUTE_IMPORT_SYNTAX_ERROR;
+        }
+        if (source->buffer_length + WAL_INSERT_MAX_SIZE > IMPORT_RUN_SIZE && !import_spill_run(source)) {
+            free(line);
+            return EXECUTE_IMPORT_FILE_ERROR;
+        }
+        if (source->num_entries == source->entries_capacity) {
+            source->entries_capacity = source->entries_capacity == 0 ? 1024 : source->entries_capacity * 2;
+            source->entries = realloc(source->entries, sizeof(ImportEntry) * source->entries_capacity);
+        }
+        ImportEntry* entry = &(source->entries[source->num_entries++]);
+        entry->key = row.id;
+        entry->offset = source->buffer_length;
+        source->buffer_length += wal_encode_insert(&row, source->buffer + source->buffer_length);
+        sorted = sorted && (line_num == 1 || row.id >= last_key);
+        last_key = row.id;
+    }
+    free(line);
+    if (source->num_runs > 0) {
+        // 已经有run了，剩下的也写成run再统一归并
+        if (!import_spill_run(source)) {
+            return EXECUTE_IMPORT_FILE_ERROR;
+        }
+    } else if (!sorted) {
+        qsort(source->entries, source->num_entries, sizeof(ImportEntry), compare_import_entry);
+    }
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * 按key从小到大取下一行，多个run时每次取各run当前行中最小的一个(key相同时取前面的run)
+ * @param source
+ * @param row
+ * @return 没有更多行时返回false
+ */
+static bool import_source_next(ImportSource* source, Row* row) {
+    if (source->num_runs == 0) {
+        if (source->next_entry == source->num_entries) {
+            return false;
+        }
+        wal_decode_insert(source->buffer + source->entries[source->next_entry++].offset, row);
+        return true;
+    }
+    // run的个数是文件大小除以IMPORT_RUN_SIZE，不会很多，线性查找最小值就够了
+    ImportRun* min = NULL;
+    for (uint32_t i = 0; i < source->num_runs; i++) {
+        ImportRun* run = &(source->runs[i]);
+        if (!run->done && (min == NULL || run->row.id < min->row.id)) {
+            min = run;
+        }
+    }
+    if (min == NULL) {
+        return false;
+    }
+    *row = min->row;
+    min->done = !import_read_row(min->file, &(min->row));
+    return true;
+}
+
+/**
+ * 释放导入用到的内存和临时文件
+ * @param source
+ */
+static void import_source_close(ImportSource* source) {
+    for (uint32_t i = 0; i < source->num_runs; i++) {
+        fclose(source->runs[i].file);
+    }
+    free(source->runs);
+    free(source->entries);
+    free(source->buffer);
+}
+
+/**
+ * 自底向上建树：行按key有序到达，叶子装满一个写一个，叶子都写完之后再一层一层建内部节点。
+ * 新页追加在文件末尾，攒够PAGER_MAX_WRITE_RUN页一起顺序写，不经过缓冲池；
+ * 根节点固定在0号页，最后才通过缓冲池写进去，在这之前新页都不可达
+ */
+typedef struct {
+    Pager* pager;
+    char* pages; // 攒着一起写的页，按页对齐(直接I/O要求)
+    uint32_t num_buffered;
+    uint32_t first_page_num; // pages中第一页的页编号
+    uint32_t next_page_num;
+    void* leaf; // 正在填的叶子，NULL表示还没有
+    uint32_t leaf_page_num;
+    uint32_t leaf_max_key;
+    uint32_t* children; // 当前这一层所有节点的页编号
+    uint32_t* max_keys; // 以及每个节点中最大的key
+    uint32_t num_children;
+    uint32_t children_capacity;
+} BulkLoader;
+
+/**
+ * 把攒着的页顺序写到文件末尾。写入失败时记下错误，后面的页不再写，导入结束时返回错误
+ * @param loader
+ */
+static void bulk_loader_flush(BulkLoader* loader) {
+    Pager* pager = loader->pager;
+    size_t length = (size_t)loader->num_buffered * PAGE_SIZE;
+    off_t offset = (off_t)loader->first_page_num * PAGE_SIZE;
+    size_t written = 0;
+    while (written < length && pager_error(pager) == EXECUTE_SUCCESS) {
+        ssize_t result = pwrite(pager->file_descriptor, loader->pages + written, length - written, offset + written);
+        if (result == -1) {
+            pager_fail(pager, EXECUTE_IO_ERROR);
+            break;
+        }
+        written += result;
+    }
+    pthread_mutex_lock(&(pager->mutex));
+    if ((uint64_t)offset + length > pager->file_length) {
+        pager->file_length = offset + length;
+    }
+    pager->stats.pages_written += loader->num_buffered;
+    pthread_mutex_unlock(&(pager->mutex));
+    loader->first_page_num = loader->next_page_num;
+    loader->num_buffered = 0;
+}
+
+/**
+ * 分配一个新页
+ * @param loader
+ * @param page_num 新页的编号
+ * @return 页的内存，下一次flush之前有效
+ */
+static void* bulk_loader_new_page(BulkLoader* loader, uint32_t* page_num) {
+    if (loader->num_buffered == PAGER_MAX_WRITE_RUN) {
+        bulk_loader_flush(loader);
+    }
+    void* page = loader->pages + (size_t)loader->num_buffered * PAGE_SIZE;
+    memset(page, 0, PAGE_SIZE);
+    loader->num_buffered++;
+    *page_num = loader->next_page_num++;
+    return page;
+}
+
+/**
+ * 把一个节点加到当前这一层
+ * @param loader
+ * @param page_num
+ * @param max_key
+ */
+static void bulk_loader_push(BulkLoader* loader, uint32_t page_num, uint32_t max_key) {
+    if (loader->num_children == loader->children_capacity) {
+        loader->children_capacity = loader->children_capacity == 0 ? 1024 : loader->children_capacity * 2;
+        loader->children = realloc(loader->children, sizeof(uint32_t) * loader->children_capacity);
+        loader->max_keys = realloc(loader->max_keys, sizeof(uint32_t) * loader->children_capacity);
+    }
+    loader->children[loader->num_children] = page_num;
+    loader->max_keys[loader->num_children] = max_key;
+    loader->num_children++;
+}
+
+/**
+ * 追加一行，当前叶子放不下时开始一个新叶子，叶子尽量装满
+ * @param loader
+ * @param row key必须比之前的都大
+ */
+static void bulk_loader_add(BulkLoader* loader, Row* row) {
+    void* leaf = loader->leaf;
+    if (leaf != NULL && leaf_node_free_space(leaf) < row_cell_size(row, *leaf_node_base_key(leaf)) + LEAF_NODE_SLOT_SIZE) {
+        bulk_loader_push(loader, loader->leaf_page_num, loader->leaf_max_key);
+        leaf = NULL;
+    }
+    if (leaf == NULL) {
+        leaf = loader->leaf = bulk_loader_new_page(loader, &(loader->leaf_page_num));
+        initialize_leaf_node(leaf);
+        *leaf_node_base_key(leaf) = row->id;
+    }
+    uint32_t num_cells = *leaf_node_num_cells(leaf);
+    PageOffset content_start = *leaf_node_content_start(leaf) - row_cell_size(row, *leaf_node_base_key(leaf));
+    serialize_row(row, *leaf_node_base_key(leaf), leaf + content_start);
+    *leaf_node_slot(leaf, num_cells) = content_start;
+    *leaf_node_content_start(leaf) = content_start;
+    *leaf_node_num_cells(leaf) = num_cells + 1;
+    loader->leaf_max_key = row->id;
+}
+
+/**
+ * 从第start个孩子开始，一个内部节点最多能装几个孩子。
+ * key是差值编码的，能装多少取决于这段key的跨度；剩下的孩子只有一个时少装一个，避免出现没有key的节点
+ * @param max_keys
+ * @param start
+ * @param remaining start之后(含)还有几个孩子
+ * @return 孩子个数
+ */
+static uint32_t bulk_loader_group_size(uint32_t* max_keys, uint32_t start, uint32_t remaining) {
+    uint32_t count = 1;
+    // 再加一个孩子需要count个key
+    while (count < remaining &&
+           count <= internal_node_max_keys(internal_key_width(max_keys[start + count - 1] - max_keys[start]))) {
+        count++;
+    }
+    if (remaining - count == 1 && count > 2) {
+        count--;
+    }
+    return count;
+}
+
+/**
+ * 写完最后一个叶子，逐层建内部节点，直到只剩一个节点，把它写进根页
+ * @param loader
+ * @param root 根节点的内容
+ */
+static void bulk_loader_finish(BulkLoader* loader, void* root) {
+    bulk_loader_push(loader, loader->leaf_page_num, loader->leaf_max_key);
+    if (loader->num_children == 1) {
+        // 只有一个叶子，它就是根，还没写出去，不用占新页
+        memcpy(root, loader->leaf, PAGE_SIZE);
+        loader->num_buffered--;
+        loader->next_page_num--;
+        return;
+    }
+    while (true) {
+        uint32_t* children = loader->children;
+        uint32_t* max_keys = loader->max_keys;
+        uint32_t count = loader->num_children;
+        loader->children = NULL;
+        loader->max_keys = NULL;
+        loader->num_children = 0;
+        loader->children_capacity = 0;
+
+        uint32_t first = bulk_loader_group_size(max_keys, 0, count);
+        if (first == count) {
+            // 这一层只有一个节点，就是根
+            initialize_internal_node(root);
+            internal_node_fill(root, children, max_keys, count - 1);
+            free(children);
+            free(max_keys);
+            return;
+        }
+        for (uint32_t start = 0; start < count;) {
+            uint32_t group = bulk_loader_group_size(max_keys, start, count - start);
+            uint32_t page_num;
+            void* node = bulk_loader_new_page(loader, &page_num);
+            initialize_internal_node(node);
+            internal_node_fill(node, children + start, max_keys + start, group - 1);
+            bulk_loader_push(loader, page_num, max_keys[start + group - 1]);
+            start += group;
+        }
+        free(children);
+        free(max_keys);
+    }
+}
+
+/**
+ * 导入csv文件(每行id,username,email)。
+ * 表是空的时候自底向上建树，所有页都装满并且顺序写入；表里已经有数据时按key顺序每IMPORT_BATCH_ROWS行作为一批插入。
+ * 文件中重复的id和表里已有的id会被跳过
+ * @param table
+ * @param filename
+ * @param import 输出导入和跳过的行数
+ * @return
+ */
+static ExecuteResult table_import(Table* table, const char* filename, ImportResult* import) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return EXECUTE_IMPORT_FILE_ERROR;
+    }
+    ImportSource source;
+    ExecuteResult result = import_source_open(&source, file, import);
+    fclose(file);
+    if (result != EXECUTE_SUCCESS) {
+        import_source_close(&source);
+        return result;
+    }
+
+    Pager* pager = table->pager;
+    void* root = get_page(pager, pager->root_page_num);
+    bool empty = get_node_type(root) == NODE_LEAF && *leaf_node_num_cells(root) == 0;
+    unpin_page(pager, pager->root_page_num);
+
+    uint64_t imported = 0;
+    uint64_t skipped = 0;
+    Row row;
+    bool has_previous = false;
+    uint32_t previous_key = 0;
+    char* pages = empty ? pager_arena_alloc((size_t)PAGER_MAX_WRITE_RUN * PAGE_SIZE) : NULL;
+    if (pages != NULL) {
+        // 分配不到写缓冲区时退回按批插入
+        BulkLoader loader;
+        memset(&loader, 0, sizeof(BulkLoader));
+        loader.pager = pager;
+        loader.pages = pages;
+        loader.first_page_num = loader.next_page_num = pager->num_pages;
+        while (import_source_next(&source, &row)) {
+            if (has_previous && row.id == previous_key) {
+                skipped++;
+                continue;
+            }
+            bulk_loader_add(&loader, &row);
+            has_previous = true;
+            previous_key = row.id;
+            imported++;
+        }
+        char new_root[PAGE_SIZE];
+        if (imported > 0) {
+            bulk_loader_finish(&loader, new_root);
+            bulk_loader_flush(&loader);
+            // 新页先落盘，再通过缓冲池(和wal)替换根页，崩溃时要么看到完整的树，要么还是空表
+            if (pager->wal != NULL && fdatasync(pager->file_descriptor) == -1) {
+                pager_fail(pager, EXECUTE_IO_ERROR);
+            }
+        }
+        if (imported > 0 && pager_error(pager) == EXECUTE_SUCCESS) {
+            pthread_mutex_lock(&(pager->mutex));
+            pager->num_pages = loader.next_page_num;
+            pthread_mutex_unlock(&(pager->mutex));
+            // 换根提交之后新的树才对读可见，正在读空表的快照继续读旧的根
+            // 写时复制模式下新根也放在新页，meta换根
+            if (pager->copy_on_write) {
+                uint32_t old_root_page_num = pager->root_page_num;
+                pager->root_page_num = get_unused_page_num(pager);
+                pager_free_page(pager, old_root_page_num);
+            }
+            root = get_page_for_write(pager, pager->root_page_num);
+            memcpy(root, new_root, PAGE_SIZE);
+            set_node_root(root, true);
+            unpin_page(pager, pager->root_page_num);
+            if (pager->wal != NULL) {
+                pager_checkpoint(pager);
+            }
+        }
+        munmap(loader.pages, (size_t)PAGER_MAX_WRITE_RUN * PAGE_SIZE);
+        free(loader.children);
+        free(loader.max_keys);
+    } else {
+        // 按key顺序攒一批插入一次：一批只同步一次wal、提交一次，提交之后修改过的页可以写回淘汰
+        Row* batch = malloc(sizeof(Row) * IMPORT_BATCH_ROWS);
+        bool more = true;
+        while (more && result == EXECUTE_SUCCESS && pager_error(pager) == EXECUTE_SUCCESS) {
+            uint32_t count = 0;
+            while (count < IMPORT_BATCH_ROWS && (more = import_source_next(&source, &row))) {
+                if (has_previous && row.id == previous_key) {
+                    skipped++;
+                    continue;
+                }
+                batch[count++] = row;
+                has_previous = true;
+                previous_key = row.id;
+            }
+            uint32_t inserted = count;
+            // 表满了或者b树损坏时这一批不插入，之前的批已经提交
+            result = execute_insert_batch(table, batch, &inserted, true);
+            if (result == EXECUTE_SUCCESS) {
+                imported += inserted;
+                skipped += count - inserted;
+            }
+            pager_commit(pager);
+        }
+        free(batch);
+        if (pager->wal != NULL && pager_error(pager) == EXECUTE_SUCCESS && !wal_sync(pager->wal, &(pager->stats))) {
+            pager_fail(pager, EXECUTE_IO_ERROR);
+        }
+    }
+    import_source_close(&source);
+    import->imported = imported;
+    import->skipped = skipped;
+    return pager_error(pager) != EXECUTE_SUCCESS ? pager_error(pager) : result;
+}
+
+/**
+ * 打印页管理器的I/O统计
+ * @param pager
+ */
+static void print_stats(Pager* pager) {
+    printf("pages_read: %" PRIu64 "\n", pager->stats.pages_read);
+    printf("pages_written: %" PRIu64 "\n", pager->stats.pages_written);
+    printf("pages_skipped: %" PRIu64 "\n", pager->stats.pages_skipped);
+    printf("cache_hits: %" PRIu64 "\n", pager->stats.cache_hits);
+    printf("evictions: %" PRIu64 "\n", pager->stats.evictions);
+    printf("wal_syncs: %" PRIu64 "\n", pager->stats.wal_syncs);
+    printf("checkpoints: %" PRIu64 "\n", pager->stats.checkpoints);
+    printf("pages_mapped: %" PRIu64 "\n", pager->stats.pages_mapped);
+    printf("pages_prefetched: %" PRIu64 "\n", pager->stats.pages_prefetched);
+    printf("versions_kept: %" PRIu64 "\n", pager->stats.versions_kept);
+    printf("free_pages: %u\n", pager->free_pages.count + pager->pending_free.count);
+}
+
+/**
+ * 从csv文件批量导入，空表时自底向上直接建树
+ * @param table
+ * @param filename
+ * @param result 输出导入和跳过的行数，不能解析的行号和原因
+ * @return 表满了时返回EXECUTE_TABLE_FULL，之前的行已经导入
+ */
+ExecuteResult db_import(Table* table, const char* filename, ImportResult* result) {
+    memset(result, 0, sizeof(ImportResult));
+    if (pager_error(table->pager) != EXECUTE_SUCCESS) {
+        return pager_error(table->pager);
+    }
+    pthread_mutex_lock(&(table->write_lock));
+    ExecuteResult execute_result = table_import(table, filename, result);
+    pager_commit(table->pager);
+    pthread_mutex_unlock(&(table->write_lock));
+    if (pager_error(table->pager) != EXECUTE_SUCCESS) {
+        execute_result = pager_error(table->pager);
+    }
+    return execute_result;
+}
+
+/**
+ * 切换db_execute中select结果的输出格式
+ * @param table
+ * @param mode
+ */
+void db_set_output_mode(Table* table, OutputMode mode) {
+    table->sink->mode = mode;
+}
+
+/**
+ * 打印数据库常数
+ */
+void db_print_constants() {
+    print_constants();
+}
+
+/**
+ * 打印页管理器的I/O统计
+ * @param table
+ */
+void db_print_stats(Table* table) {
+    print_stats(table->pager);
+}
+
+/**
+ * 打印btree的结构
+ * @param table
+ */
+void db_print_tree(Table* table) {
+    Snapshot snapshot;
+    pager_snapshot_begin(table->pager, &snapshot);
+    print_tree(table->pager, snapshot.root_page_num, 0, &snapshot);
+    pager_snapshot_end(table->pager, &snapshot);
+}
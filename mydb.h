@@ -0,0 +1,178 @@
+#ifndef MYDB_H
+#define MYDB_H
+
+/**
+ * libmydb的公开接口
+ * 表和预编译语句对外只是不透明的指针，内部结构(页管理器、b树、光标)都在mydb.c里
+ *
+ * 典型用法：
+ *   Table* table = db_open("test.db", &options, &open_result);
+ *   PreparedStatement* statement = db_prepare(table, "select where id between ? and ?", &result);
+ *   db_bind_int(statement, 1, 10);
+ *   db_bind_int(statement, 2, 20);
+ *   while (db_step(statement) == EXECUTE_ROW) {
+ *       db_column_int(statement, 0) ...
+ *   }
+ *   db_finalize(statement);
+ *   db_close(table);
+ *
+ * 多线程：一张表可以同时被多个线程使用，每个线程用自己的预编译语句。
+ * 读(db_step读取select)可以和其他读、和写同时进行，写(insert、delete、事务、导入)之间互斥。
+ * 每次select读的是开始时已经提交的快照，不会看到读到一半时才提交的插入，也不会挡住插入。
+ * 修改的页多到缓冲池装不下的语句(大范围的delete、很大的一批insert)会分几次提交，读可能看到其中一部分。
+ * db_execute把select结果写到表共享的输出缓冲区，只能在一个线程中使用；
+ * 事务状态(begin之后缓存的插入)也保存在表上，由所有线程共享：begin到commit/rollback之间，
+ * 其他线程的insert会加入同一个事务，所以使用事务时不能有其他线程同时写
+ *
+ * 错误：所有错误都通过返回值报告，库不会退出进程，也不打印提示(内存耗尽除外，和malloc失败一样abort)。
+ * 读写文件失败(EXECUTE_IO_ERROR)或者发现文件损坏(EXECUTE_CORRUPT)之后，出错的语句对读不可见，
+ * 之后的语句都返回同一个错误，只能db_close；db_close不再写数据库文件，保留wal，
+ * 下次打开时和崩溃之后一样恢复到最后一次持久化的状态
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef MYDB_BUILD_SHARED
+#define MYDB_API __attribute__((visibility("default"))) // 动态库只导出公开接口
+#else
+#define MYDB_API
+#endif
+
+/////////////////////////////////////////////// 宏
+// 表的列
+#define COLUMN_USERNAME_SIZE 32
+#define COLUMN_EMAIL_SIZE 255
+
+/////////////////////////////////////////////// 数据结构与枚举
+/**
+ * 解析sql语句结果枚举
+ */
+typedef enum {
+    PREPARE_SUCCESS,
+    PREPARE_UNRECOGNIZED_STATEMENT,
+    PREPARE_SYNTAX_ERROR,
+    PREPARE_STRING_TOO_LONG,
+    PREPARE_NEGATIVE_ID
+} PrepareResult;
+
+/**
+ * 打开数据库结果枚举
+ */
+typedef enum {
+    OPEN_SUCCESS,
+    OPEN_IO_ERROR, // 不能打开、读写数据库文件或者wal，或者崩溃恢复失败
+    OPEN_OUT_OF_MEMORY, // 分配不了缓冲池
+    OPEN_NOT_A_DATABASE, // 没有文件头，或者是没有文件头的旧格式
+    OPEN_UNSUPPORTED_VERSION, // 文件格式版本不是这个版本支持的
+    OPEN_PAGE_SIZE_MISMATCH, // 文件的页大小和编译时的MYDB_PAGE_SIZE不同
+    OPEN_NOT_COPY_ON_WRITE, // 要求写时复制模式，但已有的文件不是
+    OPEN_MMAP_WITH_DIRECT_IO, // mmap模式不能和直接I/O一起使用
+    OPEN_DIRECT_IO_UNSUPPORTED, // 文件系统不支持直接I/O
+    OPEN_CORRUPT // 文件长度不是页大小的整数倍，或者空闲页链表损坏
+} OpenResult;
+
+/**
+ * sql语句执行结果枚举
+ */
+typedef enum {
+    EXECUTE_SUCCESS,
+    EXECUTE_TABLE_FULL, // 表的页数到了上限；缓冲池到了上限还找不到可用的帧时表之后只能关闭
+    EXECUTE_DUPLICATE_KEY,
+    EXECUTE_NO_TRANSACTION, // commit/rollback时没有begin
+    EXECUTE_NESTED_TRANSACTION, // 事务中又begin
+    EXECUTE_UNBOUND_PARAMETER, // 语句中有占位符，要通过预编译语句绑定之后才能执行
+    EXECUTE_DELETE_IN_TRANSACTION, // 事务中只能insert，delete要在事务之外执行
+    EXECUTE_ROW, // db_step读到了一行，用db_column_*取字段
+    EXECUTE_IO_ERROR, // 读写数据库文件或者wal失败，表之后只能关闭
+    EXECUTE_CORRUPT, // b树损坏，表之后只能关闭
+    EXECUTE_IMPORT_FILE_ERROR, // 要导入的文件打不开，或者写临时文件失败
+    EXECUTE_IMPORT_SYNTAX_ERROR // 要导入的文件中有不能解析的行，行号和原因在ImportResult中
+} ExecuteResult;
+
+/**
+ * 绑定参数结果枚举
+ */
+typedef enum {
+    BIND_SUCCESS,
+    BIND_INDEX_OUT_OF_RANGE,
+    BIND_TYPE_MISMATCH, // 整数绑定到了字符串字段，或者反过来
+    BIND_STRING_TOO_LONG
+} BindResult;
+
+/**
+ * 查询结果的输出格式
+ */
+typedef enum {
+    OUTPUT_TABLE, // (1, user1, person1@example.com)
+    OUTPUT_CSV, // 逗号分隔，按RFC 4180加引号
+    OUTPUT_TSV, // tab分隔，字段中的tab和反斜杠转义
+    OUTPUT_BINARY // 每行是4字节长度 + 各列，id是4字节小端，字符串是1字节长度 + 内容
+} OutputMode;
+
+/**
+ * 打开数据库的选项
+ */
+typedef struct {
+    uint32_t num_frames; // 缓冲池帧数
+    bool use_wal; // 是否使用预写日志
+    // 组提交的大小，写时复制模式下攒多少条语句写一次meta页。默认1：语句返回时修改已经持久化。
+    // 大于1时用持久性换吞吐量：返回成功的语句要等攒够一组或者调用db_sync之后才持久化，之前崩溃会丢失
+    uint32_t wal_group_size;
+    bool use_mmap; // 读页时直接使用文件映射
+    bool use_direct_io; // 绕过内核页缓存，缓冲池是唯一的缓存
+    bool copy_on_write; // 写时复制：修改过的页写到新位置，meta页原子地换根，不用wal。已有文件按文件头自动识别
+    uint32_t read_ahead; // 扫描时预读的叶子数
+    OutputMode output_mode; // 查询结果的输出格式
+} DbOptions;
+
+/**
+ * 批量导入的结果
+ */
+typedef struct {
+    uint64_t imported; // 导入的行数
+    uint64_t skipped; // 跳过的重复id
+    uint32_t error_line; // 不能解析的行号，从1开始，0表示没有
+    PrepareResult line_error; // 这一行的解析错误
+} ImportResult;
+
+/**
+ * 表，db_open打开，db_close关闭
+ */
+typedef struct Table Table;
+
+/**
+ * 预编译语句，db_prepare创建，db_finalize释放
+ */
+typedef struct PreparedStatement PreparedStatement;
+
+//////////////////////////////////////////// 方法
+
+// 打开和关闭
+MYDB_API DbOptions default_db_options();
+MYDB_API bool parse_output_mode(const char* name, OutputMode* mode);
+MYDB_API Table* db_open(const char* filename, DbOptions* options, OpenResult* result);
+MYDB_API ExecuteResult db_close(Table* table);
+MYDB_API ExecuteResult db_sync(Table* table);
+
+// 预编译语句
+MYDB_API PreparedStatement* db_prepare(Table* table, const char* sql, PrepareResult* result);
+MYDB_API BindResult db_bind_int(PreparedStatement* prepared, uint32_t index, uint32_t value);
+MYDB_API BindResult db_bind_text(PreparedStatement* prepared, uint32_t index, const char* value);
+MYDB_API void db_clear_bindings(PreparedStatement* prepared);
+MYDB_API ExecuteResult db_step(PreparedStatement* prepared);
+MYDB_API uint32_t db_column_count(PreparedStatement* prepared);
+MYDB_API uint32_t db_column_int(PreparedStatement* prepared, uint32_t column);
+MYDB_API const char* db_column_text(PreparedStatement* prepared, uint32_t column, uint32_t* length);
+MYDB_API void db_reset(PreparedStatement* prepared);
+MYDB_API ExecuteResult db_execute(PreparedStatement* prepared);
+MYDB_API void db_finalize(PreparedStatement* prepared);
+
+// 工具：批量导入、输出格式和调试信息
+MYDB_API ExecuteResult db_import(Table* table, const char* filename, ImportResult* result);
+MYDB_API void db_set_output_mode(Table* table, OutputMode mode);
+MYDB_API void db_print_constants();
+MYDB_API void db_print_stats(Table* table);
+MYDB_API void db_print_tree(Table* table);
+
+#endif //MYDB_H
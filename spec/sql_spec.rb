@@ -1,10 +1,10 @@
 describe 'database' do
   before do
-    `rm -rf testdb.db`
+    `rm -rf testdb.db testdb.db-wal testdb.csv`
   end
-  def run_script(commands)
+  def run_script(commands, options = "")
     raw_output = nil
-    IO.popen("./cmake-build-debug/myDataBase testdb.db", "r+") do |pipe|
+    IO.popen("./cmake-build-debug/myDataBase testdb.db #{options}", "r+") do |pipe|
       commands.each do |command|
         pipe.puts command
       end
@@ -30,13 +30,77 @@ describe 'database' do
     ])
   end
 
-  it '满表错误' do
+  it '超过100页之后仍然可以插入' do
     script = (1..1401).map do |i|
       "insert #{i} user#{i} person#{i}@example.com"
     end
     script << ".exit"
     result = run_script(script)
-    expect(result[-2]).to eq('sql > 错误：表已经满了')
+    expect(result[-2]).to eq('sql > 执行完毕')
+  end
+
+  it '缓冲池很小时淘汰页面后数据仍然正确' do
+    ids = (1..2000).to_a.shuffle(random: Random.new(7))
+    script = ids.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--frames 8")
+
+    result = run_script([
+      "select",
+      ".exit",
+    ], "--frames 8")
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((1..2000).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
+  end
+
+  it 'mmap模式下读写数据正确' do
+    ids = (1..2000).to_a.shuffle(random: Random.new(8))
+    script = ids.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--frames 8 --mmap")
+
+    result = run_script([
+      "select",
+      ".stats",
+      ".exit",
+    ], "--frames 8 --mmap")
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((1..2000).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
+    expect(result).to include("pages_read: 0")
+  end
+
+  it '预读不影响范围查询的结果' do
+    ids = (1..3000).to_a.shuffle(random: Random.new(9))
+    script = ids.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script)
+
+    queries = ["select", "select where id between 1234 and 2345", ".exit"]
+    expected = run_script(queries, "--frames 16 --read-ahead 0")
+    expect(run_script(queries, "--frames 16 --read-ahead 4")).to eq(expected)
+    expect(run_script(queries, "--frames 16 --read-ahead 4 --mmap")).to eq(expected)
+  end
+
+  it '直接I/O模式下读写数据正确' do
+    ids = (1..2000).to_a.shuffle(random: Random.new(10))
+    script = ids.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--frames 8 --direct")
+
+    result = run_script([
+      "select",
+      ".exit",
+    ], "--frames 8 --direct")
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((1..2000).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
   end
 
   it '允许使用最大长度的字段' do
@@ -86,6 +150,222 @@ describe 'database' do
     ])
   end
 
+  it '插入重复的id会报错' do
+    script = [
+      "insert 1 user1 person1@example.com",
+      "insert 1 user1 person1@example.com",
+      "select",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result).to match_array([
+      "sql > 执行完毕",
+      "sql > 错误：重复的key",
+      "sql > (1, user1, person1@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '按id查询单行' do
+    script = (1..50).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select where id = 37"
+    script << "select where id = 51"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[50...(result.length)]).to eq([
+      "sql > (37, user37, person37@example.com)",
+      "执行完毕",
+      "sql > 执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '按id范围查询' do
+    script = (1..50).map do |i|
+      "insert #{i * 2} user#{i * 2} person#{i * 2}@example.com"
+    end
+    script << "select where id between 13 and 21"
+    script << "select where id between -1 and 3"
+    script << "select where name = 3"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[50...(result.length)]).to eq([
+      "sql > (14, user14, person14@example.com)",
+      "(16, user16, person16@example.com)",
+      "(18, user18, person18@example.com)",
+      "(20, user20, person20@example.com)",
+      "执行完毕",
+      "sql > ID必须为非负数",
+      "sql > 语法错误，不能解析语句",
+      "sql > ",
+    ])
+  end
+
+  it '只查询选中的列' do
+    script = (1..3).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select id"
+    script << "select email, id where id = 2"
+    script << "select * where id between 3 and 9"
+    script << "select id, id"
+    script << "select name"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[3...(result.length)]).to eq([
+      "sql > (1)",
+      "(2)",
+      "(3)",
+      "执行完毕",
+      "sql > (person2@example.com, 2)",
+      "执行完毕",
+      "sql > (3, user3, person3@example.com)",
+      "执行完毕",
+      "sql > 语法错误，不能解析语句",
+      "sql > 语法错误，不能解析语句",
+      "sql > ",
+    ])
+  end
+
+  it '按csv和tsv格式输出查询结果' do
+    script = [
+      "insert 1 ab a,b@x",
+      "insert 2 c\"d e\tf",
+      ".mode csv",
+      "select",
+      ".mode tsv",
+      "select id, email",
+      ".mode xml",
+      ".exit",
+    ]
+    result = run_script(script)
+
+    expect(result[2...(result.length)]).to eq([
+      "sql > sql > 1,ab,\"a,b@x\"",
+      "2,\"c\"\"d\",e\tf",
+      "执行完毕",
+      "sql > sql > 1\ta,b@x",
+      "2\te\\tf",
+      "执行完毕",
+      "sql > 未识别的输出格式 'xml'",
+      "sql > ",
+    ])
+  end
+
+  it 'binary格式时标准输出只有查询结果' do
+    raw_output = nil
+    IO.popen("./cmake-build-debug/myDataBase testdb.db --mode binary 2>/dev/null", "r+") do |pipe|
+      pipe.puts "insert 1 ab cd"
+      pipe.puts "insert 1 ab cd"
+      pipe.puts "select"
+      pipe.puts ".exit"
+      pipe.close_write
+      raw_output = pipe.read.b
+    end
+    expect(raw_output).to eq([10, 1, 2].pack("VVC") + "ab" + [2].pack("C") + "cd")
+  end
+
+  it '从csv文件批量导入' do
+    ids = (1..3000).to_a.shuffle(random: Random.new(5))
+    File.write("testdb.csv", ids.map { |i| "#{i},user#{i},\"person#{i}@example.com\"\n" }.join + "7,dup,dup\n")
+    result = run_script([
+      ".import testdb.csv",
+      ".import testdb.csv",
+      "select where id between 6 and 7",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "sql > 导入3000行，跳过1行重复的id",
+      "sql > 导入0行，跳过3001行重复的id",
+      "sql > (6, user6, person6@example.com)",
+      "(7, user7, person7@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+
+    result = run_script(["select", ".exit"])
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((1..3000).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
+  end
+
+  it '表里已经有数据时按批导入，跳过已有的id' do
+    File.write("testdb.csv", (1..3000).to_a.reverse.map { |i| "#{i},user#{i},person#{i}@example.com\n" }.join)
+    result = run_script([
+      "insert 7 seven seven@example.com",
+      ".import testdb.csv",
+      ".stats",
+      "select where id between 6 and 8",
+      ".exit",
+    ], "--frames 16")
+    expect(result).to include("sql > 导入2999行，跳过1行重复的id")
+    wal_syncs = result.grep(/wal_syncs: /).first.split(": ").last.to_i
+    expect(wal_syncs).to be < 10
+    expect(result.last(5)).to eq([
+      "sql > (6, user6, person6@example.com)",
+      "(7, seven, seven@example.com)",
+      "(8, user8, person8@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '多行插入和事务' do
+    result = run_script([
+      "insert (3,c,c@x), (1, a, a@x),(2,b,b@x)",
+      "insert (4,d,d@x),(1,x,x@x)",
+      "begin",
+      "insert 6 f f@x",
+      "insert (5,e,e@x)",
+      "commit",
+      "begin",
+      "insert 7 g g@x",
+      "rollback",
+      "commit",
+      "select",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "sql > 执行完毕",
+      "sql > 错误：重复的key",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 执行完毕",
+      "sql > 错误：没有正在进行的事务",
+      "sql > (1, a, a@x)",
+      "(2, b, b@x)",
+      "(3, c, c@x)",
+      "(5, e, e@x)",
+      "(6, f, f@x)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '交互模式下带占位符的语句不能执行' do
+    result = run_script([
+      "insert ? user1 person1@example.com",
+      "select where id between 1 and ?",
+      "select",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "sql > 错误：参数没有绑定",
+      "sql > 错误：参数没有绑定",
+      "sql > 执行完毕",
+      "sql > ",
+    ])
+  end
+
   it '数据持久化测试' do
     result1 = run_script([
       "insert 1 user1 person1@bar.com",
@@ -107,6 +387,62 @@ describe 'database' do
     ])
   end
 
+  it '只读会话关闭时不写任何页' do
+    script = (1..1000).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script)
+    mtime = File.mtime("testdb.db")
+
+    result = run_script([
+      "select where id = 50",
+      ".stats",
+      ".exit",
+    ])
+    expect(result).to include("pages_written: 0", "pages_read: 2", "evictions: 0")
+    expect(File.mtime("testdb.db")).to eq(mtime)
+  end
+
+  it '没有正常退出时用wal恢复已提交的插入' do
+    script = (1..200).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    # 不执行.exit，进程在读到EOF时直接退出，脏页没有写回
+    run_script(script, "--frames 8")
+    expect(File.exist?("testdb.db-wal")).to eq(true)
+
+    result = run_script([
+      "select where id between 198 and 200",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "sql > (198, user198, person198@example.com)",
+      "(199, user199, person199@example.com)",
+      "(200, user200, person200@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+    expect(File.exist?("testdb.db-wal")).to eq(false)
+  end
+
+  it '组提交合并fdatasync' do
+    script = (1..100).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".stats"
+    script << ".exit"
+    # 一次写入全部输入，等待中的输入不会触发空闲时的fdatasync
+    raw_output = nil
+    IO.popen("./cmake-build-debug/myDataBase testdb.db --wal-group 50", "r+") do |pipe|
+      pipe.write(script.map { |command| command + "\n" }.join)
+      pipe.close_write
+      raw_output = pipe.gets(nil)
+    end
+    wal_syncs = raw_output.split("\n").grep(/wal_syncs: /).first.split(": ").last.to_i
+    expect(wal_syncs).to be < 10
+  end
+
   it '打印数据库常数' do
     script = [
       ".constants",
@@ -116,12 +452,13 @@ describe 'database' do
 
     expect(result).to match_array([
       "sql > Constants:",
+      "PAGE_SIZE: 4096",
       "ROW_SIZE: 293",
       "COMMON_NODE_HEADER_SIZE: 6",
-      "LEAF_NODE_HEADER_SIZE: 10",
-      "LEAF_NODE_CELL_SIZE: 297",
-      "LEAF_NODE_SPACE_FOR_CELLS: 4086",
-      "LEAF_NODE_MAX_CELLS: 13",
+      "LEAF_NODE_HEADER_SIZE: 16",
+      "LEAF_NODE_SLOT_SIZE: 2",
+      "LEAF_NODE_MAX_CELL_SIZE: 294",
+      "LEAF_NODE_SPACE_FOR_CELLS: 4080",
       "sql > ",
     ])
   end
@@ -139,12 +476,266 @@ describe 'database' do
       "sql > 执行完毕",
       "sql > 执行完毕",
       "sql > Tree:",
-      "leaf (size 3)",
-      "  - 0 : 3",
-      "  - 1 : 1",
-      "  - 2 : 2",
+      "- leaf (size 3)",
+      "  - 1",
+      "  - 2",
+      "  - 3",
       "sql > "
     ])
   end
 
+  it '叶子节点满了之后分裂出内部节点' do
+    # 最长的行一个叶子只能放13行
+    script = (1..14).map do |i|
+      "insert #{i} #{"a" * 32} #{"a" * 255}"
+    end
+    script << ".btree"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[14...(result.length)]).to eq([
+      "sql > Tree:",
+      "- internal (size 1)",
+      "  - leaf (size 7)",
+      "    - 1",
+      "    - 2",
+      "    - 3",
+      "    - 4",
+      "    - 5",
+      "    - 6",
+      "    - 7",
+      "  - key 7",
+      "  - leaf (size 7)",
+      "    - 8",
+      "    - 9",
+      "    - 10",
+      "    - 11",
+      "    - 12",
+      "    - 13",
+      "    - 14",
+      "sql > ",
+    ])
+  end
+
+  it '短行在一个叶子中只占实际长度' do
+    script = (1..100).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".btree"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[100]).to eq("sql > Tree:")
+    expect(result[101]).to eq("- leaf (size 100)")
+  end
+
+  it '大id按差值编码，倒序插入时叶子换基准值' do
+    ids = (1..500).map { |i| 2_000_000_000 + i }.reverse
+    script = ids.map do |i|
+      "insert #{i} a b"
+    end
+    script << ".btree"
+    script << "select"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result[500]).to eq("sql > Tree:")
+    expect(result[501]).to eq("- leaf (size 500)")
+    expect(result[502]).to eq("  - 2000000001")
+    expect(result[1002]).to eq("sql > (2000000001, a, b)")
+    expect(result[1501]).to eq("(2000000500, a, b)")
+  end
+
+  it '乱序插入多页数据后按id顺序查询' do
+    ids = (1..300).to_a.shuffle(random: Random.new(42))
+    script = ids.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select"
+    script << ".exit"
+    result = run_script(script)
+
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((1..300).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
+  end
+
+  it '多层b树数据持久化' do
+    script = (1..300).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script)
+
+    result = run_script([
+      "select",
+      ".exit",
+    ])
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows.length).to eq(300)
+    expect(rows.last).to eq("(300, user300, person300@example.com)")
+  end
+
+  it '写时复制模式数据持久化，重新打开时自动识别' do
+    script = (1..300).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--cow")
+    expect(File.exist?("testdb.db-wal")).to eq(false)
+
+    result = run_script([
+      "insert 301 user301 person301@example.com",
+      "select",
+      ".exit",
+    ])
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows.length).to eq(301)
+    expect(rows.last).to eq("(301, user301, person301@example.com)")
+  end
+
+  it '写时复制模式没有正常退出时保留已提交的插入' do
+    script = (1..100).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    run_script(script, "--cow --wal-group 1000")
+
+    result = run_script([
+      "select where id between 99 and 100",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "sql > (99, user99, person99@example.com)",
+      "(100, user100, person100@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '已有的普通数据库文件不能用写时复制模式打开' do
+    run_script(["insert 1 a b", ".exit"])
+    # 程序打开时就退出了，不写命令，避免往关掉的管道里写
+    result = run_script([], "--cow")
+    expect(result).to eq(["不是写时复制模式的数据库文件"])
+  end
+
+  it '数据库文件以文件头开始，不是数据库的文件不能打开' do
+    run_script(["insert 1 a b", ".exit"])
+    expect(File.binread("testdb.db", 4)).to eq("mydb")
+
+    File.binwrite("testdb.db", "x" * 8192)
+    result = run_script([])
+    expect(result).to eq(["不是数据库文件，或者是没有文件头的旧格式"])
+  end
+
+  it '按id删除一行或者一个范围' do
+    script = (1..10).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script += [
+      "delete where id = 3",
+      "delete where id between 5 and 9",
+      "select",
+      ".exit",
+    ]
+    result = run_script(script)
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq([
+      "(1, user1, person1@example.com)",
+      "(2, user2, person2@example.com)",
+      "(4, user4, person4@example.com)",
+      "(10, user10, person10@example.com)",
+    ])
+  end
+
+  it '删除之后空出来的页被重用，文件不再变大' do
+    insert = (1..2000).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    run_script(insert + [".exit"])
+    result = run_script(["delete where id between 1 and 2000", ".stats", ".exit"])
+    expect(result).not_to include("free_pages: 0")
+    run_script(insert + [".exit"])
+    size = File.size("testdb.db")
+
+    run_script(["delete where id between 1 and 2000", ".exit"])
+    run_script(insert + [".exit"])
+    expect(File.size("testdb.db")).to eq(size)
+
+    result = run_script(["select where id between 1999 and 2000", ".exit"])
+    expect(result).to eq([
+      "sql > (1999, user1999, person1999@example.com)",
+      "(2000, user2000, person2000@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '缓冲池很小时大范围删除分几次提交，修改过的页可以淘汰' do
+    File.write("testdb.csv", (1..20000).map { |i| "#{i},user#{i},person#{i}@example.com\n" }.join)
+    run_script([".import testdb.csv", ".exit"], "--frames 8")
+    result = run_script(["delete where id between 1 and 19990", ".stats", ".exit"], "--frames 8")
+    evictions = result.grep(/evictions: /).first.split(": ").last.to_i
+    expect(evictions).to be > 0
+
+    result = run_script(["select", ".exit"], "--frames 8")
+    rows = result.map { |line| line.sub("sql > ", "") }.select { |line| line.start_with?("(") }
+    expect(rows).to eq((19991..20000).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" })
+  end
+
+  it '空闲页链表损坏时不能打开' do
+    insert = (1..2000).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    run_script(insert + ["delete where id between 1 and 1990", ".exit"])
+    data = File.binread("testdb.db")
+    # 跳过文件头和meta页，找到空闲页链表的页(节点类型2)
+    trunk = (2...(data.size / 4096)).find { |page| data.getbyte(page * 4096) == 2 }
+    expect(trunk).not_to be_nil
+
+    # 记录数超过一页能放下的数目
+    corrupt = data.dup
+    corrupt[trunk * 4096 + 10, 4] = [0xFFFFFFFF].pack("V")
+    File.binwrite("testdb.db", corrupt)
+    expect(run_script([".exit"])).to eq(["数据库文件损坏"])
+
+    # 链表指向自己，成环
+    corrupt = data.dup
+    corrupt[trunk * 4096 + 6, 4] = [trunk].pack("V")
+    File.binwrite("testdb.db", corrupt)
+    expect(run_script([".exit"])).to eq(["数据库文件损坏"])
+
+    File.binwrite("testdb.db", data)
+    expect(run_script(["select where id = 2000", ".exit"])).to eq([
+      "sql > (2000, user2000, person2000@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it 'delete必须带where条件' do
+    result = run_script([
+      "insert 1 user1 person1@example.com",
+      "delete",
+      "select",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "sql > 执行完毕",
+      "sql > 语法错误，不能解析语句",
+      "sql > (1, user1, person1@example.com)",
+      "执行完毕",
+      "sql > ",
+    ])
+  end
+
+  it '事务中不能delete' do
+    result = run_script([
+      "begin",
+      "delete where id = 1",
+      "rollback",
+      ".exit",
+    ])
+    expect(result).to include("sql > 错误：事务中不能delete")
+  end
+
 end
@@ -0,0 +1,235 @@
+// 预编译语句接口的测试：绑定的下标和类型检查、两次执行之间重新绑定、多行insert的占位符、db_step逐行读取。
+// 由ctest运行，失败时打印出错的检查并返回非0
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "mydb.h"
+
+static const char* DB_FILENAME = "prepared_test.db";
+static const char* WAL_FILENAME = "prepared_test.db-wal";
+
+static int failures = 0;
+
+/**
+ * 检查条件，不成立时记下失败，继续执行后面的检查
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: 检查失败：%s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+PreparedStatement* prepare(Table* table, const char* sql) {
+    PrepareResult result;
+    PreparedStatement* statement = db_prepare(table, sql, &result);
+    if (statement == NULL) {
+        printf("不能解析 '%s'：%d\n", sql, result);
+        exit(EXIT_FAILURE);
+    }
+    return statement;
+}
+
+/**
+ * 当前行的字符串列是不是expected
+ */
+bool column_equals(PreparedStatement* statement, uint32_t column, const char* expected) {
+    uint32_t length;
+    const char* text = db_column_text(statement, column, &length);
+    return text != NULL && length == strlen(expected) && memcmp(text, expected, length) == 0;
+}
+
+/**
+ * 读完select，返回行数，id依次写进ids
+ */
+uint32_t step_ids(PreparedStatement* statement, uint32_t* ids, uint32_t capacity) {
+    uint32_t count = 0;
+    ExecuteResult result;
+    while ((result = db_step(statement)) == EXECUTE_ROW) {
+        if (count < capacity) {
+            ids[count] = db_column_int(statement, 0);
+        }
+        count++;
+    }
+    CHECK(result == EXECUTE_SUCCESS);
+    return count;
+}
+
+/**
+ * 下标越界、类型不对、字符串过长时绑定失败，没绑定完不能执行
+ */
+void test_bind_errors(Table* table) {
+    PreparedStatement* insert = prepare(table, "insert ? ? ?");
+    // 不是select的语句没有结果列
+    CHECK(db_column_count(insert) == 0);
+    CHECK(db_bind_int(insert, 0, 1) == BIND_INDEX_OUT_OF_RANGE);
+    CHECK(db_bind_int(insert, 4, 1) == BIND_INDEX_OUT_OF_RANGE);
+    CHECK(db_bind_text(insert, 4, "a") == BIND_INDEX_OUT_OF_RANGE);
+    CHECK(db_bind_text(insert, 1, "a") == BIND_TYPE_MISMATCH);
+    CHECK(db_bind_int(insert, 2, 1) == BIND_TYPE_MISMATCH);
+    CHECK(db_bind_int(insert, 3, 1) == BIND_TYPE_MISMATCH);
+    char long_username[COLUMN_USERNAME_SIZE + 2];
+    memset(long_username, 'a', sizeof(long_username) - 1);
+    long_username[sizeof(long_username) - 1] = '\0';
+    CHECK(db_bind_text(insert, 2, long_username) == BIND_STRING_TOO_LONG);
+
+    CHECK(db_bind_int(insert, 1, 1) == BIND_SUCCESS);
+    CHECK(db_bind_text(insert, 2, "user1") == BIND_SUCCESS);
+    CHECK(db_execute(insert) == EXECUTE_UNBOUND_PARAMETER);
+    CHECK(db_bind_text(insert, 3, "person1@example.com") == BIND_SUCCESS);
+    CHECK(db_execute(insert) == EXECUTE_SUCCESS);
+
+    // 清除之后要重新绑定所有占位符
+    db_clear_bindings(insert);
+    CHECK(db_execute(insert) == EXECUTE_UNBOUND_PARAMETER);
+    db_finalize(insert);
+
+    PreparedStatement* select = prepare(table, "select where id = ?");
+    CHECK(db_bind_text(select, 1, "1") == BIND_TYPE_MISMATCH);
+    CHECK(db_step(select) == EXECUTE_UNBOUND_PARAMETER);
+    db_finalize(select);
+}
+
+/**
+ * 两次执行之间只改一部分参数，没改的参数保持上次绑定的值
+ */
+void test_rebind(Table* table) {
+    PreparedStatement* insert = prepare(table, "insert ? ? ?");
+    db_bind_text(insert, 2, "same");
+    db_bind_text(insert, 3, "same@example.com");
+    for (uint32_t id = 10; id < 20; id++) {
+        CHECK(db_bind_int(insert, 1, id) == BIND_SUCCESS);
+        CHECK(db_execute(insert) == EXECUTE_SUCCESS);
+    }
+    // 重复的id不影响之后的执行
+    db_bind_int(insert, 1, 10);
+    CHECK(db_execute(insert) == EXECUTE_DUPLICATE_KEY);
+    db_bind_int(insert, 1, 20);
+    db_bind_text(insert, 2, "other");
+    CHECK(db_execute(insert) == EXECUTE_SUCCESS);
+    db_finalize(insert);
+
+    PreparedStatement* select = prepare(table, "select id, username where id = ?");
+    db_bind_int(select, 1, 15);
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 15);
+    CHECK(column_equals(select, 1, "same"));
+    CHECK(db_step(select) == EXECUTE_SUCCESS);
+    // 重新绑定之后再读，读到的是新的那一行
+    db_bind_int(select, 1, 20);
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 20);
+    CHECK(column_equals(select, 1, "other"));
+    CHECK(db_step(select) == EXECUTE_SUCCESS);
+    db_finalize(select);
+}
+
+/**
+ * 多行insert的占位符按出现顺序编号，整条语句要么都插入，要么都不插入
+ */
+void test_multi_row_insert(Table* table) {
+    PreparedStatement* insert = prepare(table, "insert (?, ?, ?), (?, ?, ?)");
+    db_bind_int(insert, 1, 31);
+    db_bind_text(insert, 2, "user31");
+    db_bind_text(insert, 3, "person31@example.com");
+    db_bind_int(insert, 4, 30);
+    db_bind_text(insert, 5, "user30");
+    db_bind_text(insert, 6, "person30@example.com");
+    CHECK(db_bind_int(insert, 7, 32) == BIND_INDEX_OUT_OF_RANGE);
+    CHECK(db_execute(insert) == EXECUTE_SUCCESS);
+    // 第二行和表里的id重复，第一行也不插入
+    db_bind_int(insert, 1, 33);
+    CHECK(db_execute(insert) == EXECUTE_DUPLICATE_KEY);
+    db_finalize(insert);
+
+    PreparedStatement* select = prepare(table, "select id, email where id between ? and ?");
+    db_bind_int(select, 1, 30);
+    db_bind_int(select, 2, 39);
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 30);
+    CHECK(column_equals(select, 1, "person30@example.com"));
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 31);
+    CHECK(column_equals(select, 1, "person31@example.com"));
+    CHECK(db_step(select) == EXECUTE_SUCCESS);
+    db_finalize(select);
+}
+
+/**
+ * db_step按id顺序返回范围内的每一行，读完之后从头开始，db_reset可以提前结束
+ */
+void test_step(Table* table) {
+    PreparedStatement* insert = prepare(table, "insert ? ? ?");
+    db_bind_text(insert, 2, "user");
+    db_bind_text(insert, 3, "person@example.com");
+    // 倒序插入足够多的行，让叶子分裂
+    for (uint32_t id = 2000; id >= 1000; id--) {
+        db_bind_int(insert, 1, id);
+        CHECK(db_execute(insert) == EXECUTE_SUCCESS);
+    }
+    db_finalize(insert);
+
+    PreparedStatement* select = prepare(table, "select where id between ? and ?");
+    CHECK(db_column_count(select) == 3);
+    db_bind_int(select, 1, 1000);
+    db_bind_int(select, 2, 2000);
+    uint32_t ids[1001];
+    CHECK(step_ids(select, ids, 1001) == 1001);
+    bool ordered = true;
+    for (uint32_t i = 0; i < 1001; i++) {
+        ordered = ordered && ids[i] == 1000 + i;
+    }
+    CHECK(ordered);
+    // 读完之后再调用从头开始
+    CHECK(step_ids(select, ids, 1001) == 1001);
+
+    // 读到一半reset，下一次db_step从第一行开始
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 1001);
+    db_reset(select);
+    CHECK(db_step(select) == EXECUTE_ROW);
+    CHECK(db_column_int(select, 0) == 1000);
+    CHECK(column_equals(select, 1, "user"));
+    CHECK(column_equals(select, 2, "person@example.com"));
+    // 类型不对的列
+    uint32_t length;
+    CHECK(db_column_text(select, 0, &length) == NULL);
+    CHECK(db_column_int(select, 1) == 0);
+    db_reset(select);
+
+    // 范围内没有行
+    db_bind_int(select, 1, 2001);
+    db_bind_int(select, 2, 2100);
+    CHECK(db_step(select) == EXECUTE_SUCCESS);
+    db_finalize(select);
+}
+
+int main() {
+    unlink(DB_FILENAME);
+    unlink(WAL_FILENAME);
+    DbOptions options = default_db_options();
+    OpenResult open_result;
+    Table* table = db_open(DB_FILENAME, &options, &open_result);
+    if (table == NULL) {
+        printf("打开数据库失败：%d\n", open_result);
+        return EXIT_FAILURE;
+    }
+
+    test_bind_errors(table);
+    test_rebind(table);
+    test_multi_row_insert(table);
+    test_step(table);
+
+    CHECK(db_close(table) == EXECUTE_SUCCESS);
+    unlink(DB_FILENAME);
+    unlink(WAL_FILENAME);
+    if (failures > 0) {
+        printf("%d个检查失败\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}